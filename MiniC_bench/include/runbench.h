@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/* Runs `entry` of a MiniC program `calls` times under every execution mode
+   and reports first-call latency, steady-state time per call and memory */
+int runBenchmark(const std::string& path, const std::string& entry, int calls, const std::vector<int>& args);
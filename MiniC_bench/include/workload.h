@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+/* Shape of a synthetic MiniC program */
+struct WorkloadShape
+{
+    const char *name;
+    int functions;      /* function definitions, each called once from the top level */
+    int locals;         /* int locals declared per function */
+    int statements;     /* assignments per function after the declarations */
+    int exprDepth;      /* nesting depth of every initializer and assignment */
+};
+
+/* Same shape and seed always give the same program */
+std::string generateWorkload(const WorkloadShape& shape, unsigned int seed);
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "codegen.h"
+#include "node.h"
+#include "frontend.h"
+#include "timereport.h"
+#include "workload.h"
+#include "nullstream.h"
+#include "runbench.h"
+
+using namespace std;
+
+struct Measurement
+{
+    double lexMBs;          /* source megabytes per second through yylex */
+    double parseNodes;      /* AST nodes per second through yyparse (includes lexing) */
+    double codegenInsts;    /* IR instructions per second emitted by codeGen */
+    double optimizeMs;
+    double jitMs;
+};
+
+static const WorkloadShape s_Workloads[] =
+{
+    /* name          functions locals statements exprDepth */
+    { "functions",   2000,     4,     4,         3  },
+    { "deep_expr",   4,        2,     2,         400 },
+    { "long_body",   2,        16,    5000,      4  },
+    { "many_locals", 2,        3000,  0,         2  },
+};
+
+/* Only the dimension a workload stresses grows with -scale */
+static WorkloadShape scaled(const WorkloadShape& shape, double scale)
+{
+    WorkloadShape result = shape;
+    result.functions = std::max(1, (int)(shape.functions * (shape.functions > 100 ? scale : 1)));
+    result.locals = std::max(1, (int)(shape.locals * (shape.locals > 100 ? scale : 1)));
+    result.statements = (int)(shape.statements * (shape.statements > 100 ? scale : 1));
+    result.exprDepth = (int)(shape.exprDepth * (shape.exprDepth > 100 ? scale : 1));
+    return result;
+}
+
+/* Best of `iterations` runs of every phase */
+static Measurement measure(const std::string& source, int iterations)
+{
+    Measurement best = { 0, 0, 0, 1e30, 1e30 };
+
+    for (int i = 0; i < iterations; i++)
+    {
+        Stopwatch watch;
+        lexString(source);
+        double lexSeconds = watch.elapsed();
+
+        unsigned long nodes = Node::created;
+        watch.reset();
+        Block *root = parseString(source);
+        double parseSeconds = watch.elapsed();
+        nodes = Node::created - nodes;
+        if (root == NULL)
+        {
+            std::cerr << "generated workload did not parse" << endl;
+            exit(2);
+        }
+
+        CodeGenContext context;
+        context.dumpIR = false;
+        watch.reset();
+        context.generateSnippet(*root, "bench_main");
+        double codegenSeconds = watch.elapsed();
+        unsigned long insts = countInstructions(*context.module);
+
+        watch.reset();
+        context.optimize();
+        double optimizeSeconds = watch.elapsed();
+
+        /* Materialize every function, not just the ones the entry reaches */
+        watch.reset();
+        llvm::ExecutionEngine *ee = llvm::EngineBuilder(context.module).setEngineKind(llvm::EngineKind::JIT).create();
+        for (llvm::Module::iterator it = context.module->begin(); it != context.module->end(); it++)
+        {
+            if (!it->isDeclaration())
+                ee->getPointerToFunction(it);
+        }
+        double jitSeconds = watch.elapsed();
+        delete ee;      /* owns the module */
+
+        best.lexMBs = std::max(best.lexMBs, source.size() / 1e6 / lexSeconds);
+        best.parseNodes = std::max(best.parseNodes, nodes / parseSeconds);
+        best.codegenInsts = std::max(best.codegenInsts, insts / codegenSeconds);
+        best.optimizeMs = std::min(best.optimizeMs, optimizeSeconds * 1e3);
+        best.jitMs = std::min(best.jitMs, jitSeconds * 1e3);
+    }
+
+    return best;
+}
+
+static std::map<std::string, double> readBaseline(const char *path)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    std::string name;
+    double value;
+    while (in >> name >> value)
+        baseline[name] = value;
+    return baseline;
+}
+
+/* Compare one metric; `higherIsBetter` tells throughputs from times */
+static bool check(std::ostream& out, const std::map<std::string, double>& baseline, const std::string& name, 
+                  double value, bool higherIsBetter, double tolerance)
+{
+    out << "  " << left << setw(28) << name << right << setw(14) << value;
+
+    std::map<std::string, double>::const_iterator it = baseline.find(name);
+    if (it == baseline.end())
+    {
+        out << endl;
+        return true;
+    }
+
+    double change = (value - it->second) / it->second;
+    bool regressed = higherIsBetter ? change < -tolerance : change > tolerance;
+    out << setw(14) << it->second << setw(9) << setprecision(1) << change * 100 << "%" 
+        << (regressed ? "  REGRESSION" : "") << setprecision(3) << endl;
+    return !regressed;
+}
+
+static void usage(const char *name)
+{
+    std::cout << "Usage: " << name << " [-scale <f>] [-iterations <n>] [-tolerance <f>]" << endl
+              << "       " << std::string(strlen(name), ' ') << " [-baseline <file>] [-update-baseline]" << endl
+              << "       " << name << " -gen <workload> [-scale <f>] <out.c>" << endl
+              << "       " << name << " -run <file.c> <entry> [-calls <n>] [-args <i,j,...>]" << endl;
+}
+
+int main(int argc, char **argv)
+{
+    double scale = 1.0;
+    int iterations = 3;
+    double tolerance = 0.20;
+    const char *baselinePath = "baseline.txt";
+    const char *genWorkload = NULL;
+    const char *genPath = NULL;
+    bool updateBaseline = false;
+    const char *runPath = NULL;
+    const char *runEntry = NULL;
+    int calls = 1000;
+    std::vector<int> args;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "-scale") == 0 && arg + 1 < argc)
+            scale = atof(argv[++arg]);
+        else if (strcmp(argv[arg], "-iterations") == 0 && arg + 1 < argc)
+            iterations = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-tolerance") == 0 && arg + 1 < argc)
+            tolerance = atof(argv[++arg]);
+        else if (strcmp(argv[arg], "-baseline") == 0 && arg + 1 < argc)
+            baselinePath = argv[++arg];
+        else if (strcmp(argv[arg], "-update-baseline") == 0)
+            updateBaseline = true;
+        else if (strcmp(argv[arg], "-run") == 0 && arg + 2 < argc)
+        {
+            runPath = argv[++arg];
+            runEntry = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "-calls") == 0 && arg + 1 < argc)
+            calls = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-args") == 0 && arg + 1 < argc)
+        {
+            std::istringstream list(argv[++arg]);
+            std::string item;
+            while (std::getline(list, item, ','))
+                args.push_back(atoi(item.c_str()));
+        }
+        else if (strcmp(argv[arg], "-gen") == 0 && arg + 2 < argc)
+        {
+            genWorkload = argv[++arg];
+            genPath = argv[++arg];
+        }
+        else
+        {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (runPath != NULL)
+        return runBenchmark(runPath, runEntry, calls, args);
+
+    const size_t workloadCount = sizeof(s_Workloads) / sizeof(s_Workloads[0]);
+
+    /* Write a generated program instead of benchmarking */
+    if (genWorkload != NULL)
+    {
+        for (size_t w = 0; w < workloadCount; w++)
+        {
+            if (strcmp(s_Workloads[w].name, genWorkload) == 0)
+            {
+                std::ofstream out(genPath);
+                out << generateWorkload(scaled(s_Workloads[w], scale), 1);
+                return out ? 0 : -1;
+            }
+        }
+        std::cerr << "unknown workload " << genWorkload << endl;
+        return -1;
+    }
+
+    llvm::InitializeNativeTarget();
+
+    std::map<std::string, double> baseline = readBaseline(baselinePath);
+    std::ostringstream report;
+    std::ostringstream updated;
+    bool ok = true;
+
+    report << fixed << setprecision(3);
+    updated << setprecision(6);
+    report << "  " << left << setw(28) << "metric" << right << setw(14) << "value" 
+           << setw(14) << "baseline" << setw(10) << "change" << endl;
+
+    for (size_t w = 0; w < workloadCount; w++)
+    {
+        std::string source = generateWorkload(scaled(s_Workloads[w], scale), 1);
+
+        NullBuffer null;
+        std::streambuf *saved = std::cout.rdbuf(&null);
+        Measurement m = measure(source, iterations);
+        std::cout.rdbuf(saved);
+
+        std::string prefix = std::string(s_Workloads[w].name) + ".";
+        ok &= check(report, baseline, prefix + "lex_mb_per_s", m.lexMBs, true, tolerance);
+        ok &= check(report, baseline, prefix + "parse_nodes_per_s", m.parseNodes, true, tolerance);
+        ok &= check(report, baseline, prefix + "codegen_insts_per_s", m.codegenInsts, true, tolerance);
+        ok &= check(report, baseline, prefix + "optimize_ms", m.optimizeMs, false, tolerance);
+        ok &= check(report, baseline, prefix + "jit_ms", m.jitMs, false, tolerance);
+
+        updated << prefix << "lex_mb_per_s " << m.lexMBs << endl
+                << prefix << "parse_nodes_per_s " << m.parseNodes << endl
+                << prefix << "codegen_insts_per_s " << m.codegenInsts << endl
+                << prefix << "optimize_ms " << m.optimizeMs << endl
+                << prefix << "jit_ms " << m.jitMs << endl;
+    }
+
+    std::cout << report.str();
+
+    if (updateBaseline)
+    {
+        std::ofstream out(baselinePath);
+        out << updated.str();
+        std::cout << "Baseline written to " << baselinePath << endl;
+        return 0;
+    }
+
+    if (baseline.empty())
+        std::cout << "No baseline in " << baselinePath << ", run with -update-baseline to record one" << endl;
+
+    return ok ? 0 : 1;
+}
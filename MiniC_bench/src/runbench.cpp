@@ -0,0 +1,275 @@
+#include "runbench.h"
+#include "nullstream.h"
+#include "codegen.h"
+#include "node.h"
+#include "frontend.h"
+#include "emit.h"
+#include "timereport.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+
+#include <llvm/ExecutionEngine/Interpreter.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Target/TargetMachine.h>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+using namespace std;
+
+struct ModeResult
+{
+    const char *mode;
+    bool ok;
+    double buildMs;         /* AOT only: object emission and linking */
+    double firstCallMs;     /* from a ready module to the end of the first call */
+    double perCallUs;       /* mean over the remaining calls */
+    long rssKB;             /* resident memory added while the mode was running */
+    double result;
+    std::string note;
+
+    ModeResult(const char *mode) 
+        : mode(mode), ok(false), buildMs(0), firstCallMs(0), perCallUs(0), rssKB(0), result(0) { }
+};
+
+#define CALL_WITH_ARITY(R, CAST)                                                    \
+    switch (args.size())                                                            \
+    {                                                                               \
+        case 0: return CAST(((R (*)())code)());                                     \
+        case 1: return CAST(((R (*)(int))code)(args[0]));                           \
+        case 2: return CAST(((R (*)(int, int))code)(args[0], args[1]));             \
+        case 3: return CAST(((R (*)(int, int, int))code)(args[0], args[1], args[2])); \
+        default: return CAST(((R (*)(int, int, int, int))code)(args[0], args[1], args[2], args[3])); \
+    }
+
+#define AS_DOUBLE(x) (double)(x)
+#define AS_ZERO(x) ((x), 0.0)
+
+/* Call native code with exactly the signature it was compiled with */
+static double callNative(void *code, llvm::Type *pRetType, const std::vector<int>& args)
+{
+    if (pRetType->isDoubleTy())
+    {
+        CALL_WITH_ARITY(double, AS_DOUBLE)
+    }
+    else if (pRetType->isIntegerTy())
+    {
+        CALL_WITH_ARITY(int, AS_DOUBLE)
+    }
+    CALL_WITH_ARITY(void, AS_ZERO)
+}
+
+static void runEngine(ModeResult& r, llvm::Module *module, const std::string& entry, 
+                      llvm::EngineKind::Kind kind, bool mcjit, int calls, const std::vector<int>& args)
+{
+    long rss = (long)currentResidentKB();
+    Stopwatch watch;
+
+    std::string err;
+    llvm::ExecutionEngine *ee = llvm::EngineBuilder(module)
+                                    .setEngineKind(kind)
+                                    .setUseMCJIT(mcjit)
+                                    .setErrorStr(&err)
+                                    .create();
+    if (ee == NULL)
+    {
+        r.note = err;
+        delete module;
+        return;
+    }
+
+    llvm::Function *function = module->getFunction(entry);
+    llvm::Type *pRetType = function->getReturnType();
+
+    if (kind == llvm::EngineKind::Interpreter)
+    {
+        std::vector<llvm::GenericValue> values(args.size());
+        for (size_t i = 0; i < args.size(); i++)
+            values[i].IntVal = llvm::APInt(32, (uint64_t)(int64_t)args[i], true);
+
+        llvm::GenericValue v = ee->runFunction(function, values);
+        r.firstCallMs = watch.elapsed() * 1e3;
+        r.result = pRetType->isDoubleTy() ? v.DoubleVal : pRetType->isIntegerTy() ? (double)v.IntVal.getSExtValue() : 0;
+
+        watch.reset();
+        for (int i = 1; i < calls; i++)
+            ee->runFunction(function, values);
+    }
+    else
+    {
+        if (mcjit)
+            ee->finalizeObject();
+        void *code = ee->getPointerToFunction(function);
+        r.result = callNative(code, pRetType, args);
+        r.firstCallMs = watch.elapsed() * 1e3;
+
+        watch.reset();
+        for (int i = 1; i < calls; i++)
+            callNative(code, pRetType, args);
+    }
+
+    r.perCallUs = calls > 1 ? watch.elapsed() * 1e6 / (calls - 1) : 0;
+    r.rssKB = (long)currentResidentKB() - rss;
+    r.ok = true;
+    delete ee;  /* owns the module */
+}
+
+/* Emit an object, link it into a shared library with the system linker and load it */
+static void runAOT(ModeResult& r, llvm::Module *module, const std::string& entry, int calls, const std::vector<int>& args)
+{
+#ifdef _WIN32
+    const char *objPath = "minic_aot.obj";
+    const char *libPath = "minic_aot.dll";
+    std::string link = std::string("link /nologo /DLL /NOENTRY /EXPORT:") + entry + " " + objPath + " /OUT:" + libPath;
+#else
+    const char *objPath = "./minic_aot.o";
+    const char *libPath = "./minic_aot.so";
+    std::string link = std::string("cc -shared -o ") + libPath + " " + objPath;
+#endif
+
+    llvm::Type *pRetType = module->getFunction(entry)->getReturnType();
+    std::string err, object;
+    llvm::TargetMachine *machine = createHostTargetMachine(err, true);
+
+    Stopwatch build;
+    bool emitted = machine != NULL && emitObject(*module, *machine, object, err);
+    delete machine;
+    delete module;
+    if (!emitted)
+    {
+        r.note = err;
+        return;
+    }
+
+    {
+        std::ofstream out(objPath, std::ios::out | std::ios::binary);
+        out.write(object.data(), object.size());
+    }
+    if (system(link.c_str()) != 0)
+    {
+        r.note = "linking failed: " + link;
+        return;
+    }
+    r.buildMs = build.elapsed() * 1e3;
+
+    long rss = (long)currentResidentKB();
+    Stopwatch watch;
+#ifdef _WIN32
+    HMODULE handle = LoadLibraryA(libPath);
+    void *code = handle != NULL ? (void *)GetProcAddress(handle, entry.c_str()) : NULL;
+#else
+    void *handle = dlopen(libPath, RTLD_NOW | RTLD_LOCAL);
+    void *code = handle != NULL ? dlsym(handle, entry.c_str()) : NULL;
+#endif
+    if (code == NULL)
+    {
+        r.note = "could not load the linked library";
+        return;
+    }
+
+    r.result = callNative(code, pRetType, args);
+    r.firstCallMs = watch.elapsed() * 1e3;
+
+    watch.reset();
+    for (int i = 1; i < calls; i++)
+        callNative(code, pRetType, args);
+    r.perCallUs = calls > 1 ? watch.elapsed() * 1e6 / (calls - 1) : 0;
+    r.rssKB = (long)currentResidentKB() - rss;
+    r.ok = true;
+
+#ifdef _WIN32
+    FreeLibrary(handle);
+#else
+    dlclose(handle);
+#endif
+    remove(objPath);
+    remove(libPath);
+}
+
+int runBenchmark(const std::string& path, const std::string& entry, int calls, const std::vector<int>& args)
+{
+    std::string source;
+    {
+        std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+        if (!in)
+        {
+            std::cerr << "Error opening File " << path << endl;
+            return -1;
+        }
+        source.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    NullBuffer null;
+    std::streambuf *saved = std::cout.rdbuf(&null);
+    Block *root = parseString(source);
+    CodeGenContext context;
+    context.dumpIR = false;
+    context.exportFunctions = true;     /* the entry is called by name, through a C function pointer */
+    if (root != NULL)
+    {
+        context.generateSnippet(*root, "__toplevel");
+        context.optimize();
+    }
+    std::cout.rdbuf(saved);
+
+    if (root == NULL)
+    {
+        std::cerr << "parse error in " << path << endl;
+        return -1;
+    }
+
+    llvm::Function *function = context.module->getFunction(entry);
+    if (function == NULL || function->isDeclaration())
+    {
+        std::cerr << "no function " << entry << " in " << path << endl;
+        return -1;
+    }
+    if (function->arg_size() != args.size() || args.size() > 4)
+    {
+        std::cerr << entry << " takes " << function->arg_size() << " arguments, " << args.size() << " given (at most 4)" << endl;
+        return -1;
+    }
+    for (llvm::Function::arg_iterator it = function->arg_begin(); it != function->arg_end(); it++)
+    {
+        if (!it->getType()->isIntegerTy(32))
+        {
+            std::cerr << "only int arguments are supported" << endl;
+            return -1;
+        }
+    }
+
+    std::vector<ModeResult> results;
+    results.push_back(ModeResult("legacy-jit"));
+    runEngine(results.back(), llvm::CloneModule(context.module), entry, llvm::EngineKind::JIT, false, calls, args);
+    results.push_back(ModeResult("mcjit"));
+    runEngine(results.back(), llvm::CloneModule(context.module), entry, llvm::EngineKind::JIT, true, calls, args);
+    results.push_back(ModeResult("aot"));
+    runAOT(results.back(), llvm::CloneModule(context.module), entry, calls, args);
+    results.push_back(ModeResult("interpreter"));
+    runEngine(results.back(), llvm::CloneModule(context.module), entry, llvm::EngineKind::Interpreter, false, calls, args);
+    delete context.module;
+
+    std::cout << fixed << setprecision(3)
+              << left << setw(14) << "mode" << right << setw(12) << "build ms" << setw(16) << "first call ms"
+              << setw(16) << "per call us" << setw(14) << "rss KB" << setw(16) << "result" << endl;
+    for (std::vector<ModeResult>::const_iterator it = results.begin(); it != results.end(); it++)
+    {
+        std::cout << left << setw(14) << it->mode << right;
+        if (!it->ok)
+        {
+            std::cout << "  failed: " << it->note << endl;
+            continue;
+        }
+        std::cout << setw(12) << it->buildMs << setw(16) << it->firstCallMs << setw(16) << it->perCallUs
+                  << setw(14) << it->rssKB << setw(16) << it->result << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "workload.h"
+
+#include <sstream>
+
+using namespace std;
+
+/* Small deterministic generator so workloads do not depend on the CRT's rand() */
+class Random
+{
+    unsigned int state;
+
+public:
+    Random(unsigned int seed) : state(seed * 2654435761u + 1) { }
+    unsigned int next(unsigned int bound)
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) % bound;
+    }
+};
+
+/* A parameter, an already declared local or a small constant */
+static void writeLeaf(std::ostream& out, Random& random, int declared)
+{
+    unsigned int pick = random.next(4);
+    if (pick == 0)
+        out << (random.next(2) == 0 ? "a" : "b");
+    else if (pick == 1 && declared > 0)
+        out << "v" << random.next(declared);
+    else
+        out << 1 + random.next(9);
+}
+
+/* Left-deep tree so that depth grows the program linearly */
+static void writeExpr(std::ostream& out, Random& random, int depth, int declared)
+{
+    if (depth == 0)
+    {
+        writeLeaf(out, random, declared);
+        return;
+    }
+
+    static const char *ops[] = { " + ", " - ", " * " };
+    out << "(";
+    writeExpr(out, random, depth - 1, declared);
+    if (random.next(8) == 0)
+    {
+        /* division only by a non-zero constant */
+        out << " / " << 1 + random.next(9);
+    }
+    else
+    {
+        out << ops[random.next(3)];
+        writeLeaf(out, random, declared);
+    }
+    out << ")";
+}
+
+std::string generateWorkload(const WorkloadShape& shape, unsigned int seed)
+{
+    Random random(seed);
+    std::ostringstream out;
+
+    /* A bare identifier followed by '(' on the next line would parse as a call */
+    int depth = shape.exprDepth > 0 ? shape.exprDepth : 1;
+
+    for (int f = 0; f < shape.functions; f++)
+    {
+        out << "int f" << f << "(int a, int b)\n{\n";
+        for (int v = 0; v < shape.locals; v++)
+        {
+            out << "    int v" << v << " = ";
+            writeExpr(out, random, depth, v);
+            out << ";\n";
+        }
+
+        /* Assignments are expression statements and take no semicolon */
+        for (int s = 0; s < shape.statements && shape.locals > 0; s++)
+        {
+            out << "    v" << random.next(shape.locals) << " = ";
+            writeExpr(out, random, depth, shape.locals);
+            out << "\n";
+        }
+
+        /* The last statement is the function's value */
+        out << "    ";
+        writeExpr(out, random, depth, shape.locals);
+        out << "\n}\n\n";
+    }
+
+    for (int f = 0; f < shape.functions; f++)
+        out << "int r" << f << " = f" << f << "(" << f << ", " << f + 1 << ");\n";
+
+    return out.str();
+}
@@ -2,20 +2,32 @@
 	#include "node.h"
     #include <cstdio>
     #include <cstdlib>
+    #include "diagnostics.h"
 	Block *programBlock; /* the top level root node of our final AST */
 
 	extern int yylex();
 
-	extern unsigned int lineNo;
 	extern char *yytext;
-	extern char linebuf[50];
+	extern YYLTYPE yylloc;
+
+	bool parseFailed;                           /* set by every error of the current parse */
+	Diagnostics *parseDiagnostics = NULL;       /* collects the errors instead of printing them */
 
     void yyerror(char *s)
     {
-         printf("Line %d: %s at %s in this line:\n%s\n",
-                lineNo, s, yytext, linebuf);
-		 system("pause");
-		 exit(1);
+         std::string message = std::string(s) + " at '" + yytext + "'";
+         parseFailed = true;
+         if (parseDiagnostics != NULL)
+             parseDiagnostics->error(yylloc.first_column, message);
+         else
+             printf("Line %d: %s\n", yylloc.first_line, message.c_str());
+    }
+
+    /* Stamp a node with the offset of the first token of its rule */
+    template <class T> T* at(T *node, const YYLTYPE& location)
+    {
+        node->offset = location.first_column;
+        return node;
     }
 %}
 
@@ -44,7 +56,7 @@
 %token <token> LPAREN RPAREN LBRACE RBRACE COMMA DOT SEMICOLON
 %token <token> PLUS MINUS MUL DIV
 %token <token> INT FLOAT DOUBLE BOOL CHAR VOID
-%token <token> IF
+%token <token> IF PARALLEL FOR FPMODE RETURN
 
 /* Define the type of node our nonterminal symbols represent.
    The types refer to the %union declaration above. Ex: when
@@ -57,7 +69,7 @@
 %type <varvec> func_decl_args
 %type <exprvec> call_args
 %type <block> program stmts block
-%type <stmt> stmt var_decl func_decl
+%type <stmt> stmt var_decl func_decl parallel_for return_stmt
 %type <token> comparison
 
 /* Operator precedence for mathematical operators */
@@ -71,25 +83,32 @@
 program : stmts { programBlock = $1; }
 		;
 		
-stmts : stmt { $$ = new Block(); $$->statements.push_back($<stmt>1); }
-	  | stmts stmt { $1->statements.push_back($<stmt>2); }
+stmts : stmt { $$ = at(new Block(), @1); if ($1 != NULL) $$->statements.push_back($<stmt>1); }
+	  | stmts stmt { if ($2 != NULL) $1->statements.push_back($<stmt>2); }
 	  ;
 
 stmt : var_decl SEMICOLON
      | func_decl
-	 | expr { $$ = new ExprStmt(*$1); }
+	 | if_expr { $$ = $1; }
+	 | parallel_for
+	 | return_stmt
+	 | expr { $$ = at(new ExprStmt(*$1), @1); }
+	 | error SEMICOLON { $$ = NULL; yyerrok; }   /* skip to the end of the broken statement */
      ;
 
 block : LBRACE stmts RBRACE { $$ = $2; }
-	  | LBRACE RBRACE { $$ = new Block(); }
+	  | LBRACE RBRACE { $$ = at(new Block(), @1); }
+	  | LBRACE error RBRACE { $$ = at(new Block(), @1); yyerrok; }
 	  ;
 
-var_decl : ident ident { $$ = new VarDecl(*$1, *$2); }
-		 | ident ident EQUAL expr { $$ = new VarDecl(*$1, *$2, $4); }
+var_decl : ident ident { $$ = at(new VarDecl(*$1, *$2), @1); }
+		 | ident ident EQUAL expr { $$ = at(new VarDecl(*$1, *$2, $4), @1); }
 		 ;
 		
 func_decl : ident ident LPAREN func_decl_args RPAREN block 
-			{ $$ = new FuncDecl(*$1, *$2, *$4, *$6); delete $4; }
+			{ $$ = at(new FuncDecl(*$1, *$2, *$4, *$6), @1); delete $4; }
+		  | ident ident LPAREN func_decl_args RPAREN FPMODE LPAREN ident RPAREN block 
+			{ $$ = at(new FuncDecl(*$1, *$2, *$4, *$10, $8->name), @1); delete $4; }   /* $8 stays with the other nodes, see NodeArena */
 		  ;
 	
 func_decl_args : /*blank*/  { $$ = new VariableList(); }
@@ -97,18 +116,18 @@ func_decl_args : /*blank*/  { $$ = new VariableList(); }
 		  | func_decl_args COMMA var_decl { $1->push_back($<var_decl>3); }
 		  ;
 
-ident : IDENTIFIER { $$ = new Identifier(*$1); delete $1; }
+ident : IDENTIFIER { $$ = at(new Identifier(*$1), @1); delete $1; }
 	  ;
 
-numeric : INTEGER_CONSTANT { $$ = new ConstInt(atol($1->c_str())); delete $1; }
-		| DOUBLE_CONSTANT { $$ = new ConstDouble(atof($1->c_str())); delete $1; }
+numeric : INTEGER_CONSTANT { $$ = at(new ConstInt(atol($1->c_str())), @1); delete $1; }
+		| DOUBLE_CONSTANT { $$ = at(new ConstDouble(atof($1->c_str())), @1); delete $1; }
 		;
 	
-expr : ident EQUAL expr { $$ = new AssignmentExpr(*$<ident>1, *$3); }
-	 | ident LPAREN call_args RPAREN { $$ = new MethodCall(*$1, *$3); delete $3; }
+expr : ident EQUAL expr { $$ = at(new AssignmentExpr(*$<ident>1, *$3), @1); }
+	 | ident LPAREN call_args RPAREN { $$ = at(new MethodCall(*$1, *$3), @1); delete $3; }
 	 | ident { $<ident>$ = $1; }
 	 | numeric
- 	 | expr comparison expr { $$ = new BinaryOp(*$1, $2, *$3); }
+ 	 | expr comparison expr { $$ = at(new BinaryOp(*$1, $2, *$3), @1); }
      | LPAREN expr RPAREN { $$ = $2; }
 	 ;
 	
@@ -121,6 +140,16 @@ comparison : CEQ | CNE | CLT | CLE | CGT | CGE
 		   | PLUS | MINUS | MUL | DIV
 		   ;
 
-if_expr : IF LPAREN expr RPAREN block { $$ = new IfExpr($3, $5); }
+return_stmt : RETURN expr SEMICOLON { $$ = at(new ReturnStmt($2), @1); }
+			| RETURN SEMICOLON { $$ = at(new ReturnStmt(NULL), @1); }
+			;
+
+if_expr : IF LPAREN expr RPAREN block { $$ = at(new IfExpr($3, $5), @1); }
+
+parallel_for : PARALLEL FOR LPAREN ident EQUAL expr SEMICOLON expr RPAREN block
+				{ $$ = at(new ParallelFor(*$4, $6, $8, NULL, $10), @1); }
+			 | PARALLEL FOR LPAREN ident EQUAL expr SEMICOLON expr SEMICOLON expr RPAREN block
+				{ $$ = at(new ParallelFor(*$4, $6, $8, $10, $12), @1); }
+			 ;
 
 %%
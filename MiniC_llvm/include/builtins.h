@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include "node.h"
+
+/* Calls that are compiled inline instead of resolving to a MiniC function.
+   They cover the vector types: 
+     vec4d(x) / vec8i(x)             every lane set to x
+     vec4d(a, b, c, d) / vec8i(...)  one value per lane
+     lane(v, i)                      read lane i
+     with_lane(v, i, x)              copy of v with lane i set to x
+     shuffle(a, b, i0, ...)          lanes picked from a (0..n-1) and b (n..2n-1)
+     hsum(v) / hmin(v) / hmax(v)     horizontal reductions
+   Lane numbers must be constants. Sets found to false when the callee is
+   not a builtin. */
+llvm::Value* codeGenBuiltin(CodeGenContext& context, const MethodCall& call, bool& found);
@@ -1,6 +1,10 @@
 #pragma once
 
-#include <stack>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <string>
 #include <typeinfo>
 
 #include <llvm\Config\config.h>
@@ -13,6 +17,8 @@
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/CallingConv.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/DataLayout.h>
 #else
 #include <llvm/Module.h>
 #include <llvm/Function.h>
@@ -22,6 +28,8 @@
 #include <llvm/IRBuilder.h>
 #include <llvm/Instructions.h>
 #include <llvm/CallingConv.h>
+#include <llvm/Intrinsics.h>
+#include <llvm/DataLayout.h>
 #endif
 
 #include <llvm/PassManager.h>
@@ -31,35 +39,184 @@
 #include <llvm/PassManager.h>
 #include <llvm/Analysis/Passes.h>
 #include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/Vectorize.h>
 #include <llvm/Assembly/PrintModulePass.h>
 #include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetOptions.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/ExecutionEngine/JIT.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "emit.h"
+#include "source.h"
 
 class Block;
-static llvm::IRBuilder<> g_Builder(llvm::getGlobalContext());
+class Identifier;
+class CodeGenContext;
+class TimeReport;
+class ProfileBuilder;
+class CounterBuilder;
+class DebugInfo;
+class DiagnosticStream;
+
+/* Variables in scope during code generation. All scopes share one vector
+   of entries, and a scope is what lies above the watermark taken when it
+   was entered. The index leads from a name to its innermost entry, which
+   remembers the entry it shadows, so a lookup is one hash probe and
+   leaving a scope only touches the entries declared in it. */
+class SymbolTable
+{
+    /* Names stay in the index once seen, with -1 while not in scope */
+    typedef std::unordered_map<std::string, int> Index;
 
+public:
+    struct Entry
+    {
+        Index::value_type *binding; /* name and innermost entry of the name */
+        llvm::Value *value;
+        int shadowed;               /* entry this one hides, or -1 */
+        unsigned int frame;         /* function the value belongs to */
+    };
+
+private:
+    std::vector<Entry> entries;
+    std::vector<size_t> marks;
+    Index index;
+
+public:
+    void push() { marks.push_back(entries.size()); }
+    void pop();
+    void declare(const std::string& name, llvm::Value *value, unsigned int frame);
+    Entry* find(const std::string& name);
+    size_t depth() const { return marks.size(); }
+};
+
+/* A function being generated */
 class CodeGenBlock 
 {
 public:
     llvm::BasicBlock *block;
-    std::map<std::string, llvm::Value*> locals;
+    size_t depth;                   /* of the scope holding the parameters */
+
+    /* Outlined bodies reach the locals of the function they came from
+       through an array of pointers, filled in the order of captures;
+       captured has the names and the loaded pointers in the same order */
+    llvm::Value *captureArray;
+    std::vector<llvm::Value*> captures;
+    std::vector<std::pair<const std::string*, llvm::Value*> > captured;
+
+    /* return statements store the result in returnSlot (NULL for void)
+       and branch to returnBlock; both NULL where return is not allowed */
+    llvm::BasicBlock *returnBlock;
+    llvm::Value *returnSlot;
+
+    CodeGenBlock() : block(NULL), depth(0), captureArray(NULL), returnBlock(NULL), returnSlot(NULL) { }
 };
 
+llvm::Type *typeOf(llvm::LLVMContext& ctx, const Identifier& type);
+bool convertible(llvm::Type *pFrom, llvm::Type *pTo);
+llvm::Value* convertTo(CodeGenContext& context, llvm::IRBuilder<>& builder, llvm::Value *pValue, llvm::Type *pType, SourceOffset offset);
+
+/* Floating point semantics of double arithmetic:
+   strict    IEEE results, operations are never merged or reordered
+   contract  a * b + c may become a fused multiply-add
+   fast      also reassociate, ignore NaN/Inf/-0 and use reciprocals,
+             which makes FP reductions vectorizable */
+enum FPMode { FP_STRICT, FP_CONTRACT, FP_FAST };
+bool parseFPMode(const std::string& name, FPMode& mode);
+
+/* The verifier checks every generated module unless this is a release build */
+#ifdef NDEBUG
+const bool DEFAULT_VERIFY = false;
+#else
+const bool DEFAULT_VERIFY = true;
+#endif
+
+/* Same as LLVM's default for -O2 */
+const unsigned int DEFAULT_INLINE_THRESHOLD = 225;
+
 class CodeGenContext 
 {
-    std::stack<CodeGenBlock *> blocks;
-    llvm::Function *mainFunction;
+    std::vector<CodeGenBlock> frames;   /* innermost last */
+    SymbolTable symbols;
+    llvm::Function *initFunction;       /* runs the top level statements */
+
+    /* Definitions of modules already handed to the engine, by name */
+    std::map<std::string, llvm::GlobalValue*> externals;
+
+    llvm::Value* capture(unsigned int frame, const SymbolTable::Entry& entry);
+
+    FPMode functionFPMode;          /* of the function being generated */
+    DebugInfo *debugInfo;           /* while generating code with sourceLines set */
 
 public:
+    llvm::LLVMContext& llvmContext;
+    llvm::IRBuilder<> builder;
     llvm::Module *module;
-    CodeGenContext() { module = new llvm::Module("main", llvm::getGlobalContext()); }
+    llvm::ExecutionEngine *engine;  /* set when modules are added to a long-lived JIT */
+    bool interactive;               /* top-level variables outlive a snippet and stay writable */
+    bool dumpIR;                    /* print the module before and after optimization */
+    bool optimizeCode;              /* run optimize() at the end of generateCode() */
+    bool verifyCode;                /* run the verifier before optimize(), see DEFAULT_VERIFY */
+    unsigned int inlineThreshold;   /* inline cost limit of optimize(), 0 inlines only alwaysinline */
+    FPMode fpMode;                  /* for functions without an fpmode(...) of their own */
+    TargetSelection target;         /* CPU the JIT generates code for */
+    llvm::TargetMachine *targetMachine; /* when set, optimize() uses its data layout and cost model */
+    TimeReport *timeReport;         /* phase and pass timings are recorded here when set */
+    ProfileBuilder *profile;        /* instruments the code, or annotates it with a profile */
+    CounterBuilder *counters;       /* adds the execution counters that stay on in production */
+    bool exportFunctions;           /* functions get external linkage and the C convention for a host to call */
+    std::ostream *logStream;        /* progress messages */
+    std::ostream *errorStream;      /* undeclared names and other semantic errors */
+    DiagnosticStream *diagnostics;  /* when set, takes the errors instead, with the offset of their node */
+    unsigned int errorCount;        /* messages written through error() */
+    const SourceMap *sourceLines;   /* when set, DWARF line tables for sourcePath are emitted and MCJIT is used */
+    std::string sourcePath;
+
+    CodeGenContext(llvm::LLVMContext& llvmContext = llvm::getGlobalContext()) 
+        : initFunction(NULL), functionFPMode(FP_STRICT), debugInfo(NULL), llvmContext(llvmContext), builder(llvmContext), engine(NULL), 
+          interactive(false), dumpIR(true), optimizeCode(true), verifyCode(DEFAULT_VERIFY), inlineThreshold(DEFAULT_INLINE_THRESHOLD), fpMode(FP_STRICT), 
+          targetMachine(NULL), timeReport(NULL), profile(NULL), counters(NULL), exportFunctions(false), logStream(&std::cout), errorStream(&std::cerr), 
+          diagnostics(NULL), errorCount(0), sourceLines(NULL)
+    { 
+        module = new llvm::Module("main", llvmContext); 
+    }
+
+    std::ostream& log() { return *logStream; }
+    std::ostream& error(SourceOffset offset = NO_OFFSET);
     
-    void generateCode(Block& root);
+    bool generateCode(Block& root);
+    llvm::Function* generateSnippet(Block& root, const std::string& name);
+    void optimize();
+    llvm::ExecutionEngine* createEngine(std::string& err);
     llvm::GenericValue runCode();
-    std::map<std::string, llvm::Value*>& locals() { return blocks.top()->locals; }
-    llvm::BasicBlock *currentBlock() { return blocks.top()->block; }
-    void pushBlock(llvm::BasicBlock *block) { blocks.push(new CodeGenBlock()); blocks.top()->block = block; }
-    void popBlock() { CodeGenBlock *top = blocks.top(); blocks.pop(); delete top; }
+    llvm::Function* entryFunction() const { return initFunction; }
+
+    DebugInfo* debug() { return debugInfo; }
+    FPMode currentFPMode() const { return functionFPMode; }
+    void setFPMode(FPMode mode);
+    llvm::FastMathFlags fastMathFlags() const;
+
+    void newModule(const std::string& name);
+    void publishModule();
+    llvm::Function* lookupFunction(const std::string& name);
+    llvm::Value* lookupVariable(const std::string& name);
+
+    /* Outside of any function, and not in a nested block either */
+    bool atTopLevel() const { return frames.size() == 1 && symbols.depth() <= frames.back().depth + 1; }
+    void declare(const std::string& name, llvm::Value *value) { symbols.declare(name, value, (unsigned int)frames.size() - 1); }
+    void rebind(const std::string& name, llvm::Value *value);
+    void pushScope() { symbols.push(); }
+    void popScope() { symbols.pop(); }
+    llvm::BasicBlock *currentBlock() { return frames.back().block; }
+    void setCurrentBlock(llvm::BasicBlock *block) { frames.back().block = block; }
+    void pushBlock(llvm::BasicBlock *block);
+    void pushOutlinedBlock(llvm::BasicBlock *block, llvm::Value *captureArray);
+    void popBlock() { symbols.pop(); frames.pop_back(); }
+    const std::vector<llvm::Value*>& captures() { return frames.back().captures; }
+    llvm::BasicBlock *returnBlock() { return frames.back().returnBlock; }
+    llvm::Value *returnSlot() { return frames.back().returnSlot; }
+    void setReturn(llvm::BasicBlock *block, llvm::Value *slot) { frames.back().returnBlock = block; frames.back().returnSlot = slot; }
 };
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace llvm
+{
+    class Function;
+    class Instruction;
+    class Value;
+}
+
+/* Execution counters cheap enough to leave on in production. Every thread
+   that runs instrumented code gets its own table of 64 bit slots, so a count
+   is a plain add without atomics or shared cache lines. The tables are
+   registered in one place where the host sums them up when it reads them;
+   reads while code runs are approximate. */
+
+/* Loop trip counts are kept as a histogram: bucket b counts the runs with
+   2^b <= trips < 2^(b+1), bucket 0 also the empty ones */
+const unsigned int TRIP_BUCKETS = 32;
+
+/* Slots per thread table. The memory is only touched where counters are. */
+const unsigned int DEFAULT_COUNTER_SLOTS = 1 << 16;
+
+struct FunctionCounts
+{
+    uint64_t calls;
+    uint64_t cycles;    /* readcyclecounter ticks spent inside, callees included */
+};
+
+/* Functions and loops are named "<module identifier>:<name>" */
+struct CounterSnapshot
+{
+    std::map<std::string, FunctionCounts> functions;
+    std::map<std::string, std::vector<uint64_t> > loops;   /* TRIP_BUCKETS runs each */
+    unsigned int uncounted;         /* functions and loops left out, every slot was taken */
+    unsigned int missingTables;     /* threads whose table could not be allocated */
+
+    CounterSnapshot() : uncounted(0), missingTables(0) { }
+
+    /* The hottest functions by cycles, or by calls without cycle counters */
+    void printHot(std::ostream& out, unsigned int top) const;
+};
+
+/* Call before instrumented code is generated; false without the memory */
+bool enableCounters(bool cycles, unsigned int slots = DEFAULT_COUNTER_SLOTS);
+bool countersEnabled();
+CounterSnapshot readCounters();
+
+/* Call once the code of a module is gone. Its counts are dropped and the
+   slots go to modules compiled later. */
+void releaseCounters(const std::string& module);
+
+/* Called by instrumented code for the table of the running thread */
+extern "C" uint64_t* minic_counter_table();
+
+/* Hooked into code generation when counters are enabled. Adds a call count
+   at every function entry, with cycle counters the time to every return,
+   and trip count histograms to loops. */
+class CounterBuilder
+{
+    struct Entry
+    {
+        unsigned int slot;
+        llvm::Value *table;
+        llvm::Value *start;     /* cycle counter at entry, or NULL */
+    };
+
+    std::map<llvm::Function*, Entry> entries;
+
+public:
+    void functionEntry(llvm::Function *function);
+    void functionExit(llvm::Instruction *ret);
+    void loop(llvm::Instruction *before, const std::string& name, llvm::Value *low, llvm::Value *high);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <llvm/DIBuilder.h>
+#include <llvm/DebugInfo.h>
+#include <llvm/Support/DebugLoc.h>
+#include <llvm/Config/config.h>
+#if defined(LLVM_VERSION_MAJOR) && LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR > 2 
+#include <llvm/IR/IRBuilder.h>
+#else
+#include <llvm/IRBuilder.h>
+#endif
+
+#include "source.h"
+
+/* Hooked into code generation to describe the module in DWARF: one compile
+   unit for the source file, a subprogram per generated function and the
+   line and column of every statement, so that debuggers and profilers can
+   map JIT'd code back to MiniC source. */
+class DebugInfo
+{
+    struct Scope
+    {
+        llvm::MDNode *subprogram;
+        llvm::DebugLoc location;    /* last one set in this function */
+    };
+
+    llvm::DIBuilder builder;
+    const SourceMap& lines;
+    bool optimized;
+    llvm::DIFile file;
+    std::vector<Scope> scopes;      /* functions being generated, innermost last */
+
+    llvm::DIType typeOf(llvm::Type *pType);
+
+public:
+    DebugInfo(llvm::Module& module, const SourceMap& lines, const std::string& path, bool optimized);
+
+    /* Instructions generated between these belong to function */
+    void beginFunction(llvm::IRBuilder<>& irBuilder, llvm::Function *function, SourceOffset offset);
+    void endFunction(llvm::IRBuilder<>& irBuilder);
+
+    /* Attribute the instructions generated from now on to offset */
+    void setLocation(llvm::IRBuilder<>& irBuilder, SourceOffset offset);
+
+    void finalize() { builder.finalize(); }
+};
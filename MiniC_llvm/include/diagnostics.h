@@ -0,0 +1,71 @@
+#pragma once
+
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "source.h"
+
+/* One message about the source; offset is NO_OFFSET when it has no position */
+struct Diagnostic
+{
+    enum Severity { ERROR, WARNING };
+
+    Severity severity;
+    SourceOffset offset;
+    std::string message;
+};
+
+/* Collects the messages of one compilation, so that all errors of a file
+   are reported together and none of them ends the process */
+class Diagnostics
+{
+    std::vector<Diagnostic> entries;
+    unsigned int errors;
+
+    void add(Diagnostic::Severity severity, SourceOffset offset, const std::string& message);
+
+public:
+    unsigned int maxErrors;     /* errors past this are counted but not kept */
+    SourceMap lines;            /* turns offsets into line and column when printing */
+
+    Diagnostics() : errors(0), maxErrors(100) { }
+
+    void error(SourceOffset offset, const std::string& message);
+    void warning(SourceOffset offset, const std::string& message);
+
+    bool hasErrors() const { return errors > 0; }
+    unsigned int errorCount() const { return errors; }
+    const std::vector<Diagnostic>& all() const { return entries; }
+    void clear() { entries.clear(); errors = 0; }
+
+    /* One "file(line,column): error: message" line per entry, as Visual Studio reads them */
+    void print(std::ostream& out, const std::string& fileName = "") const;
+    std::string str(const std::string& fileName = "") const;
+};
+
+/* Stream that turns every line written to it into an error of a
+   Diagnostics, at the offset set last */
+class DiagnosticStream : public std::ostream
+{
+    class Buffer : public std::streambuf
+    {
+    public:
+        Diagnostics& diagnostics;
+        SourceOffset offset;
+        std::string line;
+
+        Buffer(Diagnostics& diagnostics) : diagnostics(diagnostics), offset(NO_OFFSET) { }
+
+    protected:
+        virtual int overflow(int c);
+    };
+
+    Buffer buffer;
+
+public:
+    DiagnosticStream(Diagnostics& diagnostics) : std::ostream(&buffer), buffer(diagnostics) { }
+
+    void setOffset(SourceOffset offset) { buffer.offset = offset; }
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace llvm
+{
+    class Module;
+    class TargetMachine;
+    class TargetOptions;
+}
+
+/* CPU and feature set to generate code for. The default is the CPU we run
+   on; naming an older one (e.g. -mcpu=x86-64) keeps objects portable. */
+struct TargetSelection
+{
+    std::string cpu;                    /* empty for the host CPU */
+    std::vector<std::string> attrs;     /* +feature / -feature */
+
+    std::string cpuName() const;
+    std::string features() const;
+    void parseAttrs(const std::string& list);
+};
+
+/* Options shared by the JIT and object emission. FP contraction is left to
+   the llvm.fmuladd calls and fast-math flags codegen puts on each
+   instruction, so the fpmode of every function is kept; nothing here
+   relaxes FP semantics for a whole module. */
+void initTargetOptions(llvm::TargetOptions& options);
+
+/* Ahead-of-time output of a generated module */
+llvm::TargetMachine* createTargetMachine(const TargetSelection& selection, std::string& err, bool pic = false);
+llvm::TargetMachine* createHostTargetMachine(std::string& err, bool pic = false);
+bool emitObject(llvm::Module& module, llvm::TargetMachine& machine, std::string& out, std::string& err);
+void emitBitcode(llvm::Module& module, std::string& out);
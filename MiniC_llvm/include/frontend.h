@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+class Block;
+class Diagnostics;
+
+/* Run lexer and parser; they return NULL when the input did not parse.
+   The parser recovers from syntax errors to report all of them; they are
+   printed, or collected in diagnostics when given. The generated lexer
+   and parser are not reentrant: one parse at a time. */
+Block* parseFile(FILE *file);
+Block* parseFile(FILE *file, Diagnostics& diagnostics);
+Block* parseString(const std::string& source);
+Block* parseString(const std::string& source, Diagnostics& diagnostics);
+
+/* Zero bytes that must follow the text given to the buffer functions */
+const size_t SCAN_PADDING = 2;
+
+/* Same as parseString, but the text is scanned in place instead of being
+   copied: text[length] and text[length + 1] must be zero. The lexer writes
+   to the text while scanning and restores it before returning. */
+Block* parseBuffer(char *text, size_t length);
+Block* parseBuffer(char *text, size_t length, Diagnostics& diagnostics);
+
+/* Run only the lexer over the file and rewind it; returns the token count */
+unsigned long lexFile(FILE *file);
+unsigned long lexString(const std::string& source);
+unsigned long lexBuffer(char *text, size_t length);
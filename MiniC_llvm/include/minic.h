@@ -0,0 +1,86 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "diagnostics.h"
+
+class Block;
+
+namespace llvm
+{
+    class ExecutionEngine;
+    class Function;
+    class LLVMContext;
+    class TargetMachine;
+}
+
+/* Settings of one compilation */
+struct CompileOptions
+{
+    bool optimize;
+    unsigned int inlineThreshold;       /* 0 inlines only alwaysinline functions */
+    std::string fpMode;                 /* strict, contract or fast */
+    std::string cpu;                    /* empty for the host CPU */
+    std::vector<std::string> attrs;     /* +feature / -feature */
+    bool debugInfo;                     /* DWARF line tables, registered with debuggers */
+    bool counters;                      /* execution counters, see enableCounters and readCounters */
+    std::string sourceName;             /* file name the line tables refer to */
+
+    CompileOptions() : optimize(true), inlineThreshold(225), fpMode("strict"), debugInfo(false), counters(false), sourceName("<input>") { }
+};
+
+/* Machine code of one source text. Every function has the C calling
+   convention, so lookup() results can be cast to plain function pointers. */
+class CompiledModule
+{
+    friend class Compiler;
+
+    llvm::LLVMContext *llvmContext;     /* of this module only */
+    llvm::ExecutionEngine *engine;      /* owns the module */
+    llvm::Function *initFunction;
+
+    CompiledModule(llvm::LLVMContext *llvmContext, llvm::ExecutionEngine *engine, llvm::Function *initFunction)
+        : llvmContext(llvmContext), engine(engine), initFunction(initFunction) { }
+    CompiledModule(const CompiledModule&);
+    CompiledModule& operator=(const CompiledModule&);
+
+public:
+    ~CompiledModule();
+
+    /* Address of a function defined in the source, NULL if there is none */
+    void* lookup(const std::string& name);
+
+    /* Address of a top level variable, NULL if there is none. Constant
+       initializers are in place from the start, others only after run();
+       variables the source never assigns to are read-only. */
+    void* global(const std::string& name);
+
+    /* Run the top level statements of the source */
+    void run();
+};
+
+/* Embeddable compiler. Nothing is printed and errors never end the process;
+   modules have their own LLVM context, so they can be compiled and used on
+   any thread. */
+class Compiler
+{
+    std::mutex mutex;
+    std::map<std::string, llvm::TargetMachine*> machines;  /* by cpu and features */
+
+    llvm::TargetMachine* targetMachine(const CompileOptions& options, std::string& err);
+    CompiledModule* compile(Block& root, const CompileOptions& options, Diagnostics& diagnostics);
+
+public:
+    Compiler();
+    ~Compiler();
+
+    /* Returns NULL when the source is rejected; every error found is in diagnostics */
+    CompiledModule* compileString(const std::string& source, const CompileOptions& options, Diagnostics& diagnostics);
+
+    /* Same without copying the source; text[length] and text[length + 1]
+       must be zero, see parseBuffer */
+    CompiledModule* compileBuffer(char *text, size_t length, const CompileOptions& options, Diagnostics& diagnostics);
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <afunix.h>     /* AF_UNIX, Windows 10 SDK and later */
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET socket_t;
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#endif
+
+/* Thin portability layer over Unix domain stream sockets */
+
+inline void initSockets()
+{
+#ifdef _WIN32
+    static bool initialized = false;
+    if (!initialized)
+    {
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+        initialized = true;
+    }
+#endif
+}
+
+inline void closeSocket(socket_t s)
+{
+#ifdef _WIN32
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+inline bool fillAddress(const std::string& path, struct sockaddr_un& addr)
+{
+    if (path.size() >= sizeof(addr.sun_path))
+        return false;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+inline bool sendAll(socket_t s, const void *data, size_t size)
+{
+    const char *p = (const char *)data;
+    while (size > 0)
+    {
+        int n = send(s, p, (int)size, 0);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+inline bool recvAll(socket_t s, void *data, size_t size)
+{
+    char *p = (char *)data;
+    while (size > 0)
+    {
+        int n = recv(s, p, (int)size, 0);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
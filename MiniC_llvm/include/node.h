@@ -2,8 +2,11 @@
 #define __NODE__
 
 #include <iostream>
+#include <string>
 #include <vector>
 
+#include "source.h"
+
 #include <llvm\Config\config.h>
 #if defined(LLVM_VERSION_MAJOR) && LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR > 2 
 #include <llvm/IR/Value.h>
@@ -20,11 +23,52 @@ typedef std::vector<Stmt*> StatementList;
 typedef std::vector<Expr*> ExpressionList;
 typedef std::vector<VarDecl*> VariableList;
 
+class Node;
+
+/* Owns every node created with new while it is in use, typically the tree
+   of one parse, and destroys them together. Nodes are bump allocated from
+   large chunks. Nodes created while no arena is in use are never freed, so
+   no node is ever deleted on its own: the parser only deletes the lists
+   and strings it copied out of. */
+class NodeArena
+{
+    std::vector<char*> chunks;
+    std::vector<Node*> nodes;
+    size_t used;                    /* bytes taken from the last chunk */
+
+    NodeArena(const NodeArena&);
+    NodeArena& operator=(const NodeArena&);
+
+public:
+    static NodeArena *current;
+
+    NodeArena() : used(0) { }
+    ~NodeArena();
+
+    void* allocate(size_t size);
+
+    /* Makes an arena the current one for a scope; not thread safe, like the parser */
+    class Use
+    {
+        NodeArena *previous;
+
+    public:
+        Use(NodeArena& arena) : previous(current) { current = &arena; }
+        ~Use() { current = previous; }
+    };
+};
+
 class Node
 {
 public:
+    static unsigned long created;   /* nodes constructed so far, for -time-report */
+    SourceOffset offset;            /* where the node's text starts */
+
+    Node() : offset(NO_OFFSET) { created++; }
     virtual ~Node() {}
     virtual llvm::Value* codeGen(CodeGenContext& context) { return NULL; }
+
+    static void* operator new(size_t size);
 };
 
 class Expr : public Node
@@ -108,6 +152,16 @@ public:
     virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
+/* return [expr]; leaves the function through its return block */
+class ReturnStmt : public Stmt
+{
+public:
+    Expr *expression;   /* NULL for a bare return */
+    ReturnStmt(Expr *expression) :
+        expression(expression) { }
+    virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
 class VarDecl : public Stmt
 {
 public:
@@ -119,6 +173,7 @@ public:
     VarDecl(const Identifier& type, Identifier& id, Expr *assignmentExpr) :
         type(type), id(id), assignmentExpr(assignmentExpr) { }
     virtual llvm::Value* codeGen(CodeGenContext& context);
+    llvm::Value* codeGenGlobal(CodeGenContext& context);
 };
 
 class FuncDecl : public Stmt
@@ -128,9 +183,13 @@ public:
     const Identifier& id;
     VariableList arguments;
     Block& block;
+    std::string fpMode;     /* from fpmode(...), empty for the module's mode */
     FuncDecl(const Identifier& type, const Identifier& id, 
             const VariableList& arguments, Block& block) :
         type(type), id(id), arguments(arguments), block(block) { }
+    FuncDecl(const Identifier& type, const Identifier& id, 
+            const VariableList& arguments, Block& block, const std::string& fpMode) :
+        type(type), id(id), arguments(arguments), block(block), fpMode(fpMode) { }
     virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -147,4 +206,23 @@ public:
     virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
+/* parallel for (var = lo; hi [; grain]) block
+   The block is outlined into its own function and run by the runtime's
+   worker pool, so iterations must not depend on each other. */
+class ParallelFor : public Stmt
+{
+public:
+    Identifier& var;
+    Expr*       m_pLow;
+    Expr*       m_pHigh;
+    Expr*       m_pGrain;   /* NULL lets the runtime choose */
+    Block*      m_pBlock;
+
+    ParallelFor(Identifier& var, Expr* pLow, Expr* pHigh, Expr* pGrain, Block* pBlock)
+        : var(var), m_pLow(pLow), m_pHigh(pHigh), m_pGrain(pGrain), m_pBlock(pBlock)
+    {}
+
+    virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <ostream>
+#include <streambuf>
+
+/* Swallows the code generator's progress output while measuring */
+class NullBuffer : public std::streambuf
+{
+protected:
+    virtual int overflow(int c) { return c; }
+};
+
+/* Stream for output nobody asked for */
+class NullStream : public std::ostream
+{
+    NullBuffer buffer;
+
+public:
+    NullStream() : std::ostream(&buffer) { }
+};
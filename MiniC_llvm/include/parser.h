@@ -12,6 +12,23 @@ typedef union {
 	std::string *string;
 	int token;
 } YYSTYPE;
+
+#ifndef YYLTYPE
+typedef
+  struct yyltype
+    {
+      int timestamp;
+      int first_line;
+      int first_column;
+      int last_line;
+      int last_column;
+      char *text;
+   }
+  yyltype;
+
+#define YYLTYPE yyltype
+#endif
+
 #define	IDENTIFIER	258
 #define	INTEGER_CONSTANT	259
 #define	DOUBLE_CONSTANT	260
@@ -40,6 +57,10 @@ typedef union {
 #define	CHAR	283
 #define	VOID	284
 #define	IF	285
+#define	PARALLEL	286
+#define	FOR	287
+#define	FPMODE	288
+#define	RETURN	289
 
 
 extern YYSTYPE yylval;
@@ -0,0 +1,23 @@
+#pragma once
+
+namespace llvm
+{
+    class JITEventListener;
+}
+
+/* Symbols for Linux perf. A perf map (/tmp/perf-<pid>.map) is enough for
+   `perf report` to name JIT'd frames; a jitdump (/tmp/jit-<pid>.dump) also
+   keeps the code, so that `perf inject --jit` can annotate it. Record with
+   `perf record -k mono` for the jitdump timestamps to match. */
+enum PerfOutput
+{
+    PERF_MAP     = 1,
+    PERF_JITDUMP = 2
+};
+
+/* Call before any code is JIT'd; outputs is a combination of PerfOutput */
+bool enablePerfMap(unsigned int outputs);
+bool perfMapEnabled();
+
+/* Writes every function the JIT emits to the enabled outputs */
+llvm::JITEventListener* perfJITListener();
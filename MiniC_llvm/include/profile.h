@@ -0,0 +1,68 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace llvm
+{
+    class BasicBlock;
+    class BranchInst;
+    class CallInst;
+    class ExecutionEngine;
+    class Function;
+    class GlobalVariable;
+    class Instruction;
+    class Module;
+}
+
+/* Counts of an instrumented run. Branches and calls are identified by the
+   module and function they are in and their position within it, which
+   stays the same as long as the source does. */
+class Profile
+{
+public:
+    typedef std::pair<std::string, unsigned int> Site;
+
+    std::map<std::string, uint64_t> entries;                    /* calls per function */
+    std::map<Site, std::pair<uint64_t, uint64_t> > branches;    /* taken, not taken */
+    std::map<Site, std::pair<std::string, uint64_t> > calls;    /* callee, calls */
+
+    bool read(const char *path);
+    bool write(const char *path) const;
+};
+
+/* Hooked into code generation. When instrumenting, counters are added for
+   every function entry, branch and call and read back into the profile after
+   the run. Otherwise the profile's counts are attached to the IR as branch
+   weights, and as attributes that the inliner and code placement look at. */
+class ProfileBuilder
+{
+    struct Counter
+    {
+        char kind;                  /* 'f'unction, 'b'ranch executed, 't'aken, 'c'all */
+        Profile::Site site;
+        std::string callee;
+        llvm::GlobalVariable *var;
+    };
+
+    Profile& profile;
+    bool instrument;
+    std::map<std::string, unsigned int> sites;
+    std::map<std::string, std::string> modules;     /* module identifier, canonical path */
+    std::vector<Counter> counters;
+
+    std::string functionName(llvm::Function *function);
+    Profile::Site nextSite(llvm::Function *function);
+    void addCounter(llvm::BasicBlock *block, llvm::Instruction *before, char kind, const Profile::Site& site, const std::string& callee);
+
+public:
+    ProfileBuilder(Profile& profile, bool instrument) : profile(profile), instrument(instrument) { }
+
+    void functionEntry(llvm::Function *function);
+    void branch(llvm::BranchInst *branch);
+    void call(llvm::CallInst *call);
+    void annotate(llvm::Module *module);
+    void collect(llvm::ExecutionEngine *engine);
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "codegen.h"
+
+/* Interactive session: one CodeGenContext and one JIT that live as long as
+   the process. Every snippet is compiled into a fresh module that is added
+   to the same engine, so functions and top-level variables carry over. */
+class ReplSession
+{
+    CodeGenContext context;
+    unsigned int snippetCount;
+
+public:
+    ReplSession();
+    ~ReplSession();
+
+    bool eval(const std::string& source, std::ostream& out);
+    int run(std::istream& in, std::ostream& out);
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+/* Support code that compiled MiniC programs call into */
+
+/* Body of a parallel for: runs iterations [lo, hi) with the captured
+   variables of the enclosing function passed in ctx */
+typedef void (*ParallelBody)(void **ctx, int lo, int hi);
+
+/* Runs body over [lo, hi) in chunks of grain iterations on the worker pool
+   and returns when every chunk is done. The calling thread works as well,
+   so nested loops cannot starve the pool. grain <= 0 picks a size that
+   gives every thread several chunks to balance. The pool has one thread
+   per core unless MINIC_THREADS says otherwise. */
+extern "C" void minic_parallel_for(ParallelBody body, void **ctx, int lo, int hi, int grain);
+
+/* Makes the functions above, and minic_counter_table, resolvable by name
+   for every JIT */
+void registerRuntime();
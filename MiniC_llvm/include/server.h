@@ -0,0 +1,94 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "codegen.h"
+#include "netsock.h"
+
+namespace llvm
+{
+    class TargetMachine;
+}
+
+/* Wire format on the local socket. A request is a RequestHeader followed by
+   `length` bytes of MiniC source, a response a ResponseHeader followed by
+   `length` bytes of payload: bitcode, an object file, the printed result of
+   a run, or an error message. Both ends live on the same host, so fields are
+   sent in host byte order. A connection may carry any number of requests. */
+const unsigned int PROTOCOL_MAGIC = 0x434e694d; /* "MiNC" */
+
+/* Largest source a request may carry; anything longer is refused before
+   the server allocates for it */
+const unsigned int MAX_REQUEST_LENGTH = 16 * 1024 * 1024;
+
+enum RequestKind
+{
+    REQUEST_BITCODE = 1,
+    REQUEST_OBJECT  = 2,
+    REQUEST_RUN     = 3
+};
+
+enum ResponseStatus
+{
+    RESPONSE_OK    = 0,
+    RESPONSE_ERROR = 1
+};
+
+struct RequestHeader
+{
+    unsigned int magic;
+    unsigned int kind;
+    unsigned int length;            /* at most MAX_REQUEST_LENGTH */
+};
+
+struct ResponseHeader
+{
+    unsigned int status;
+    unsigned int length;
+};
+
+/* Compiled output for one source, kept so a hash collision can be told apart */
+struct CacheEntry
+{
+    unsigned int kind;
+    std::string source;
+    std::string output;
+};
+
+/* Long-lived compiler process. Target initialization, the target machine
+   and the JIT are set up once; compile results are cached by a hash of
+   the source text and checked against the stored text on a hit. */
+class CompileServer
+{
+    llvm::TargetMachine *machine;
+    llvm::ExecutionEngine *engine;
+    std::multimap<size_t, CacheEntry> cache;
+
+    bool compile(unsigned int kind, char *source, size_t length, std::string& out);
+    bool execute(char *source, size_t length, std::string& out);
+
+public:
+    CompileServer();
+    ~CompileServer();
+
+    /* source is followed by SCAN_PADDING zero bytes, see parseBuffer */
+    bool handle(unsigned int kind, char *source, size_t length, std::string& out);
+    int run(const std::string& path);
+};
+
+/* Client side of the protocol */
+class CompileClient
+{
+    socket_t fd;
+
+public:
+    CompileClient();
+    ~CompileClient();
+
+    bool connect(const std::string& path);
+    bool request(unsigned int kind, const std::string& source, unsigned int& status, std::string& out);
+};
+
+int runClient(const std::string& path, unsigned int kind, const std::string& source);
+int benchServer(const std::string& path, unsigned int kind, const std::string& source, int iterations);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+/* Byte offset into the compiled text. 32 bits keep AST nodes small and
+   limit a single input to 4 GB. */
+typedef unsigned int SourceOffset;
+const SourceOffset NO_OFFSET = 0xffffffff;
+
+/* Start offset of every line, recorded by the lexer as it passes the
+   newlines. Line and column are only computed when a message needs them. */
+class SourceMap
+{
+    std::vector<SourceOffset> lineStarts;
+
+public:
+    SourceMap() : lineStarts(1, 0) { }
+
+    void clear() { lineStarts.assign(1, 0); }
+    void newLine(SourceOffset start) { lineStarts.push_back(start); }
+    void swap(SourceMap& other) { lineStarts.swap(other.lineStarts); }
+
+    /* 1-based line and column of an offset */
+    void resolve(SourceOffset offset, unsigned int& line, unsigned int& column) const;
+};
+
+/* Position of a token or rule in the parser. These are the fields bison's
+   location code copies around; the lexer stores byte offsets in the
+   column fields. */
+struct ParserLocation
+{
+    int timestamp;
+    int first_line;
+    int first_column;
+    int last_line;
+    int last_column;
+    char *text;
+};
+
+#define YYLTYPE ParserLocation
+#define YYLTYPE_IS_DECLARED 1
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "codegen.h"
+
+/* Two-tier execution of a module. Every defined function starts out in a
+   baseline engine that runs no IR passes and uses fast instruction
+   selection, and counts its calls. Calls between functions go through a
+   table of code pointers. When a function reaches the threshold a worker
+   thread compiles it again with the optimizing pipeline in its own
+   LLVMContext and swaps the table entry, so later calls run the fast code. */
+class TieredEngine
+{
+    unsigned int threshold;
+    std::vector<std::string> names;             /* function name by tier id */
+    std::atomic<void*> *slots;                  /* current code of every function */
+    unsigned int *counts;                       /* calls made to the baseline code */
+    std::map<std::string, void*> globals;       /* addresses of the baseline engine's globals */
+
+    llvm::ExecutionEngine *baseline;
+    std::string bitcode;                        /* module before instrumentation */
+
+    /* Owned by the worker thread */
+    llvm::LLVMContext *optContext;
+    llvm::Module *optModule;
+    llvm::ExecutionEngine *optimized;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<unsigned int> queue;
+    bool stopping;
+
+    void instrument(llvm::Module *module);
+    void compileOptimized(unsigned int id);
+    void workerLoop();
+
+public:
+    TieredEngine(llvm::Module *module, unsigned int threshold);
+    ~TieredEngine();
+
+    bool valid() const { return baseline != NULL; }
+    void run(llvm::Function *entry);
+    void promote(unsigned int id);
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "timing.h"
+#include "trace.h"
+
+namespace llvm
+{
+    class Module;
+}
+
+/* Collects per-phase and per-pass wall times plus a few size counters for
+   -time-report, printed either as a table or as JSON */
+class TimeReport
+{
+public:
+    struct Entry
+    {
+        std::string name;
+        double value;
+        Entry(const std::string& name, double value) : name(name), value(value) { }
+    };
+
+private:
+    std::vector<Entry> phases;
+    std::vector<Entry> passes;
+    std::vector<Entry> counters;
+
+public:
+    void addPhase(const std::string& name, double seconds);
+    void addPass(const std::string& name, double seconds);
+    void setCounter(const std::string& name, double value);
+
+    void print(std::ostream& out) const;
+    void printJSON(std::ostream& out) const;
+};
+
+/* Adds the lifetime of the object as a phase, and as a span when tracing */
+class PhaseTimer
+{
+    TimeReport *report;
+    const char *name;
+    Stopwatch watch;
+    TraceSpan span;
+
+public:
+    PhaseTimer(TimeReport *report, const char *name) : report(report), name(name), span("phase", name) { }
+    ~PhaseTimer() { if (report != NULL) report->addPhase(name, watch.elapsed()); }
+};
+
+unsigned long countInstructions(const llvm::Module& module);
+unsigned long peakResidentKB();
+unsigned long currentResidentKB();
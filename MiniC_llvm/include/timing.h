@@ -0,0 +1,36 @@
+#pragma once
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Monotonic wall clock in seconds with the best resolution the OS offers */
+inline double nowSeconds()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+class Stopwatch
+{
+    double start;
+
+public:
+    Stopwatch() : start(nowSeconds()) { }
+    void reset() { start = nowSeconds(); }
+    double elapsed() const { return nowSeconds() - start; }
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+namespace llvm
+{
+    class JITEventListener;
+}
+
+/* Chrome trace-event recording (chrome://tracing, ui.perfetto.dev).
+   Events are appended to a buffer owned by the recording thread, so a span
+   costs two clock reads and a push_back; buffers are only merged when the
+   trace is written. */
+void enableTrace();
+bool traceEnabled();
+void traceComplete(const char *category, const std::string& name, double start, double end);
+void traceInstant(const char *category, const std::string& name, const char *argName, double argValue);
+bool writeTrace(const std::string& path);
+
+/* Reports every function the JIT emits as an instant event with its size */
+llvm::JITEventListener* traceJITListener();
+
+/* Records its own lifetime as a complete ("X") event */
+class TraceSpan
+{
+    const char *category;
+    std::string name;
+    double start;
+    bool active;
+
+public:
+    TraceSpan(const char *category, const std::string& name);
+    ~TraceSpan();
+};
@@ -0,0 +1,136 @@
+#include "builtins.h"
+#include "codegen.h"
+
+using namespace std;
+
+static llvm::Value* lanes(CodeGenContext& context, SourceOffset offset, llvm::IRBuilder<>& builder, llvm::Type *pType, const std::vector<llvm::Value*>& args)
+{
+    llvm::VectorType *pVecType = llvm::cast<llvm::VectorType>(pType);
+    unsigned int count = pVecType->getNumElements();
+    if (args.size() == 1)
+        return convertTo(context, builder, args[0], pVecType, offset);
+
+    if (args.size() != count)
+    {
+        context.error(offset) << "expected 1 or " << count << " lanes" << endl;
+        return NULL;
+    }
+
+    llvm::Value *pVec = llvm::UndefValue::get(pVecType);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        llvm::Value *pLane = convertTo(context, builder, args[i], pVecType->getElementType(), offset);
+        if (pLane == NULL)
+            return NULL;
+        pVec = builder.CreateInsertElement(pVec, pLane, builder.getInt32(i));
+    }
+    return pVec;
+}
+
+/* Reduce by folding the upper half onto the lower half, log2(lanes) steps */
+static llvm::Value* reduce(llvm::IRBuilder<>& builder, const std::string& op, llvm::Value *pVec)
+{
+    unsigned int count = llvm::cast<llvm::VectorType>(pVec->getType())->getNumElements();
+    bool bFloat = pVec->getType()->isFPOrFPVectorTy();
+    for (unsigned int half = count / 2; half >= 1; half /= 2)
+    {
+        std::vector<llvm::Constant*> mask;
+        for (unsigned int i = 0; i < count; i++)
+            mask.push_back(builder.getInt32(i < half ? i + half : i));
+        llvm::Value *pUpper = builder.CreateShuffleVector(pVec, pVec, llvm::ConstantVector::get(mask));
+
+        if (op == "hsum")
+            pVec = bFloat ? builder.CreateFAdd(pVec, pUpper) : builder.CreateAdd(pVec, pUpper);
+        else 
+        {
+            llvm::Value *pLess = bFloat ? builder.CreateFCmpOLT(pVec, pUpper) : builder.CreateICmpSLT(pVec, pUpper);
+            pVec = op == "hmin" ? builder.CreateSelect(pLess, pVec, pUpper) : builder.CreateSelect(pLess, pUpper, pVec);
+        }
+    }
+    return builder.CreateExtractElement(pVec, builder.getInt32(0));
+}
+
+static bool constantLane(CodeGenContext& context, const Expr& arg, llvm::Value *pValue, unsigned int limit, unsigned int& lane)
+{
+    llvm::ConstantInt *pConst = llvm::dyn_cast<llvm::ConstantInt>(pValue);
+    if (pConst == NULL || pConst->getZExtValue() >= limit)
+    {
+        context.error(arg.offset) << "lane numbers must be constants below " << limit << endl;
+        return false;
+    }
+    lane = (unsigned int)pConst->getZExtValue();
+    return true;
+}
+
+llvm::Value* codeGenBuiltin(CodeGenContext& context, const MethodCall& call, bool& found)
+{
+    const std::string& name = call.id.name;
+    const ExpressionList& arguments = call.arguments;
+    static const char *names[] = { "vec4d", "vec8i", "lane", "with_lane", "shuffle", "hsum", "hmin", "hmax" };
+    found = false;
+    for (unsigned int i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        found |= (name == names[i]);
+    if (!found)
+        return NULL;
+
+    context.log() << "Creating builtin: " << name << endl;
+
+    std::vector<llvm::Value*> args;
+    for (ExpressionList::const_iterator it = arguments.begin(); it != arguments.end(); it++)
+    {
+        llvm::Value *pArg = (**it).codeGen(context);
+        if (pArg == NULL)
+            return NULL;
+        args.push_back(pArg);
+    }
+
+    llvm::IRBuilder<> builder(context.currentBlock());
+    builder.SetFastMathFlags(context.fastMathFlags());
+
+    if (name == "vec4d" || name == "vec8i")
+        return lanes(context, call.offset, builder, typeOf(context.llvmContext, Identifier(name)), args);
+
+    if (args.empty() || !args[0]->getType()->isVectorTy())
+    {
+        context.error(call.offset) << name << " expects a vector as first argument" << endl;
+        return NULL;
+    }
+    llvm::VectorType *pVecType = llvm::cast<llvm::VectorType>(args[0]->getType());
+    unsigned int count = pVecType->getNumElements();
+    unsigned int lane;
+
+    if (name == "lane" && args.size() == 2)
+    {
+        if (!constantLane(context, *arguments[1], args[1], count, lane))
+            return NULL;
+        return builder.CreateExtractElement(args[0], builder.getInt32(lane));
+    }
+
+    if (name == "with_lane" && args.size() == 3)
+    {
+        if (!constantLane(context, *arguments[1], args[1], count, lane))
+            return NULL;
+        llvm::Value *pLane = convertTo(context, builder, args[2], pVecType->getElementType(), arguments[2]->offset);
+        if (pLane == NULL)
+            return NULL;
+        return builder.CreateInsertElement(args[0], pLane, builder.getInt32(lane));
+    }
+
+    if (name == "shuffle" && args.size() == 2 + count && args[1]->getType() == pVecType)
+    {
+        std::vector<llvm::Constant*> mask;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            if (!constantLane(context, *arguments[2 + i], args[2 + i], 2 * count, lane))
+                return NULL;
+            mask.push_back(builder.getInt32(lane));
+        }
+        return builder.CreateShuffleVector(args[0], args[1], llvm::ConstantVector::get(mask));
+    }
+
+    if ((name == "hsum" || name == "hmin" || name == "hmax") && args.size() == 1)
+        return reduce(builder, name, args[0]);
+
+    context.error(call.offset) << "wrong arguments for " << name << endl;
+    return NULL;
+}
@@ -0,0 +1,140 @@
+#include "server.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+CompileClient::CompileClient() : fd(INVALID_SOCKET)
+{
+    initSockets();
+}
+
+CompileClient::~CompileClient()
+{
+    if (fd != INVALID_SOCKET)
+        closeSocket(fd);
+}
+
+bool CompileClient::connect(const std::string& path)
+{
+    struct sockaddr_un addr;
+    if (!fillAddress(path, addr))
+        return false;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == INVALID_SOCKET)
+        return false;
+
+    if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        closeSocket(fd);
+        fd = INVALID_SOCKET;
+        return false;
+    }
+    return true;
+}
+
+bool CompileClient::request(unsigned int kind, const std::string& source, unsigned int& status, std::string& out)
+{
+    if (source.size() > MAX_REQUEST_LENGTH)
+    {
+        status = RESPONSE_ERROR;
+        out = "source too large";
+        return true;
+    }
+
+    RequestHeader request;
+    request.magic = PROTOCOL_MAGIC;
+    request.kind = kind;
+    request.length = (unsigned int)source.size();
+    if (!sendAll(fd, &request, sizeof(request)) || !sendAll(fd, source.data(), source.size()))
+        return false;
+
+    ResponseHeader response;
+    if (!recvAll(fd, &response, sizeof(response)))
+        return false;
+
+    out.assign(response.length, '\0');
+    if (response.length > 0 && !recvAll(fd, &out[0], response.length))
+        return false;
+
+    status = response.status;
+    return true;
+}
+
+/* Send one request and write the payload to stdout */
+int runClient(const std::string& path, unsigned int kind, const std::string& source)
+{
+    CompileClient client;
+    if (!client.connect(path))
+    {
+        std::cerr << "Could not connect to " << path << endl;
+        return -1;
+    }
+
+    unsigned int status;
+    std::string out;
+    if (!client.request(kind, source, status, out))
+    {
+        std::cerr << "Connection lost" << endl;
+        return -1;
+    }
+
+    if (status != RESPONSE_OK)
+    {
+        std::cerr << "error: " << out << endl;
+        return 1;
+    }
+
+    std::cout.write(out.data(), out.size());
+    if (kind == REQUEST_RUN)
+        std::cout << endl;
+    return 0;
+}
+
+/* Latency and throughput of one request kind over a single connection */
+int benchServer(const std::string& path, unsigned int kind, const std::string& source, int iterations)
+{
+    CompileClient client;
+    if (!client.connect(path))
+    {
+        std::cerr << "Could not connect to " << path << endl;
+        return -1;
+    }
+
+    std::vector<double> samples;
+    unsigned int status;
+    std::string out;
+
+    Stopwatch total;
+    for (int i = 0; i < iterations; i++)
+    {
+        Stopwatch latency;
+        if (!client.request(kind, source, status, out) || status != RESPONSE_OK)
+        {
+            std::cerr << "Request " << i << " failed" << endl;
+            return 1;
+        }
+        samples.push_back(latency.elapsed());
+    }
+    double seconds = total.elapsed();
+
+    if (samples.empty())
+        return 0;
+
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (size_t i = 0; i < samples.size(); i++)
+        sum += samples[i];
+
+    std::cout << "requests:   " << samples.size() << endl;
+    std::cout << "min:        " << samples.front() * 1e6 << " us" << endl;
+    std::cout << "mean:       " << sum / samples.size() * 1e6 << " us" << endl;
+    std::cout << "p50:        " << samples[samples.size() / 2] * 1e6 << " us" << endl;
+    std::cout << "p99:        " << samples[samples.size() * 99 / 100] * 1e6 << " us" << endl;
+    std::cout << "max:        " << samples.back() * 1e6 << " us" << endl;
+    std::cout << "throughput: " << samples.size() / seconds << " req/s" << endl;
+    return 0;
+}
@@ -1,102 +1,654 @@
 #include "node.h"
 #include "codegen.h"
 #include "parser.h"
+#include "timereport.h"
+#include "profile.h"
+#include "counters.h"
+#include "builtins.h"
+#include "runtime.h"
+#include "debuginfo.h"
+#include "perfmap.h"
+#include "diagnostics.h"
+
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/Support/Host.h>
+
+#include <algorithm>
 
 using namespace std;
 
-/* Compile the AST into a module */
-void CodeGenContext::generateCode(Block& root)
+unsigned long Node::created = 0;
+NodeArena *NodeArena::current = NULL;
+
+/* Bytes per chunk, and the alignment malloc would give */
+static const size_t ARENA_CHUNK = 64 * 1024;
+static const size_t ARENA_ALIGN = 2 * sizeof(void*);
+
+NodeArena::~NodeArena()
+{
+    /* Nodes only refer to each other, so they can go in any order */
+    for (std::vector<Node*>::iterator it = nodes.begin(); it != nodes.end(); it++)
+        (*it)->~Node();
+    for (std::vector<char*>::iterator it = chunks.begin(); it != chunks.end(); it++)
+        delete[] *it;
+}
+
+void* NodeArena::allocate(size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (chunks.empty() || used + size > ARENA_CHUNK)
+    {
+        chunks.push_back(new char[std::max(size, ARENA_CHUNK)]);
+        used = 0;
+    }
+    void *p = chunks.back() + used;
+    used += size;
+    nodes.push_back((Node*)p);
+    return p;
+}
+
+void* Node::operator new(size_t size)
+{
+    if (NodeArena::current != NULL)
+        return NodeArena::current->allocate(size);
+    return ::operator new(size);
+}
+
+/* The transformations run by optimize(), in order. The interprocedural
+   passes come first so that the scalar passes clean up the merged bodies. */
+static void addOptimizationPasses(std::vector<llvm::Pass*>& passes, unsigned int inlineThreshold)
+{
+    passes.push_back(llvm::createDeadArgEliminationPass());    /* internal functions only */
+    if (inlineThreshold > 0)
+        passes.push_back(llvm::createFunctionInliningPass(inlineThreshold));
+    else
+        passes.push_back(llvm::createAlwaysInlinerPass());
+    passes.push_back(llvm::createPromoteMemoryToRegisterPass());
+    passes.push_back(llvm::createInstructionCombiningPass());
+    passes.push_back(llvm::createReassociatePass());
+    passes.push_back(llvm::createGVNPass());
+    passes.push_back(llvm::createLoopRotatePass());
+    passes.push_back(llvm::createLoopVectorizePass());       /* FP reductions need fpmode(fast) */
+    passes.push_back(llvm::createSLPVectorizerPass());
+    passes.push_back(llvm::createTailCallEliminationPass());   /* self recursion in tail position becomes a loop */
+    passes.push_back(llvm::createCFGSimplificationPass());
+}
+
+/* The vectorizers need the data layout and the target's cost model to do anything */
+static void addTargetAnalyses(llvm::PassManager& pm, llvm::TargetMachine *machine)
+{
+    if (machine == NULL)
+        return;
+    pm.add(new llvm::DataLayout(*machine->getDataLayout()));
+    machine->addAnalysisPasses(pm);
+}
+
+/* Globals that are only ever loaded become constants, which puts them in
+   read-only data and lets the optimizer fold their values into the code */
+static void markReadOnlyGlobals(llvm::Module& module)
+{
+    for (llvm::Module::global_iterator it = module.global_begin(); it != module.global_end(); it++)
+    {
+        if (it->isDeclaration() || it->isConstant())
+            continue;
+
+        bool loadedOnly = true;
+        for (llvm::Value::use_iterator use = it->use_begin(); use != it->use_end() && loadedOnly; use++)
+            loadedOnly = llvm::isa<llvm::LoadInst>(*use);
+        if (loadedOnly)
+            it->setConstant(true);
+    }
+}
+
+/* One message per call, ended with endl */
+std::ostream& CodeGenContext::error(SourceOffset offset)
+{
+    errorCount++;
+    if (diagnostics == NULL)
+        return *errorStream;
+    diagnostics->setOffset(offset);
+    return *diagnostics;
+}
+
+/* Compile the AST into a module; false on semantic errors or if the verifier rejects it */
+bool CodeGenContext::generateCode(Block& root)
 {
-    std::cout << "Generating code...\n";
+    unsigned int errorsBefore = errorCount;
+    log() << "Generating code...\n";
+    {
+        PhaseTimer timer(timeReport, "codegen");
     
-    /* Create the top level interpreter function to call as entry */
-    vector<llvm::Type*> argTypes;
-    llvm::FunctionType *ftype = llvm::FunctionType::get(llvm::Type::getVoidTy(llvm::getGlobalContext()), llvm::makeArrayRef(argTypes), false);
-    mainFunction = llvm::Function::Create(ftype, llvm::GlobalValue::InternalLinkage, "main", module);
-    llvm::BasicBlock *bblock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "entry", mainFunction, 0);
-    g_Builder.SetInsertPoint(bblock);
+        /* The top level statements, and the initializers of globals that
+           are not constant, run in the init function called as entry */
+        vector<llvm::Type*> argTypes;
+        llvm::FunctionType *ftype = llvm::FunctionType::get(llvm::Type::getVoidTy(llvmContext), llvm::makeArrayRef(argTypes), false);
+        /* External, or the inliner would drop it as an unused internal function */
+        initFunction = llvm::Function::Create(ftype, llvm::GlobalValue::ExternalLinkage, "minic.init", module);
+        llvm::BasicBlock *bblock = llvm::BasicBlock::Create(llvmContext, "entry", initFunction, 0);
+        builder.SetInsertPoint(bblock);
 
-    /* Push a new variable/block context */
-    pushBlock(bblock);
-    llvm::Value* pRetVal = root.codeGen(*this); /* emit bytecode for the toplevel block */
-    g_Builder.CreateRet(pRetVal);
-    popBlock();
+        if (sourceLines != NULL)
+            debugInfo = new DebugInfo(*module, *sourceLines, sourcePath, optimizeCode);
+
+        /* Push a new variable/block context */
+        pushBlock(bblock);
+        setFPMode(fpMode);
+        if (debugInfo != NULL)
+            debugInfo->beginFunction(builder, initFunction, root.offset);
+        if (profile != NULL)
+            profile->functionEntry(initFunction);
+        if (counters != NULL)
+            counters->functionEntry(initFunction);
+        root.codeGen(*this); /* emit bytecode for the toplevel block */
+        llvm::ReturnInst *ret = builder.CreateRetVoid();
+        if (counters != NULL)
+            counters->functionExit(ret);
+        if (debugInfo != NULL)
+            debugInfo->endFunction(builder);
+        popBlock();
+
+        if (debugInfo != NULL)
+        {
+            debugInfo->finalize();
+            delete debugInfo;
+            debugInfo = NULL;
+        }
+
+        if (profile != NULL)
+            profile->annotate(module);
+
+        /* Later snippets may assign to the globals of a REPL */
+        if (!interactive)
+            markReadOnlyGlobals(*module);
+    }
     
+    log() << "Code is generated.\n";
+    if (errorCount != errorsBefore)
+        return false;
+
+    if (verifyCode)
+    {
+        PhaseTimer timer(timeReport, "verify");
+        std::string err;
+        if (llvm::verifyModule(*module, llvm::ReturnStatusAction, &err))
+        {
+            error() << "invalid module: " << err << endl;
+            return false;
+        }
+    }
+
+    if (optimizeCode)
+        optimize();
+    return true;
+}
+
+/* Run the optimization pipeline over the current module */
+void CodeGenContext::optimize()
+{
+    PhaseTimer timer(timeReport, "optimize");
+
     /* Print the bytecode in a human-readable format 
        to see if our program compiled properly
      */
-    std::cout << "Code is generated.\n";
-    llvm::PassManager pm;
-    pm.add(llvm::createPrintModulePass(&llvm::outs()));
-    pm.add(llvm::createBasicAliasAnalysisPass());
-    
-    pm.add(llvm::createInstructionCombiningPass());
+    if (dumpIR)
+        module->print(llvm::outs(), NULL);
+
+    if (targetMachine != NULL)
+    {
+        module->setTargetTriple(targetMachine->getTargetTriple());
+        module->setDataLayout(targetMachine->getDataLayout()->getStringRepresentation());
+    }
+
+    std::vector<llvm::Pass*> passes;
+    addOptimizationPasses(passes, inlineThreshold);
+
+    if (timeReport == NULL && !traceEnabled())
+    {
+        llvm::PassManager pm;
+        addTargetAnalyses(pm, targetMachine);
+        pm.add(llvm::createBasicAliasAnalysisPass());
+        for (std::vector<llvm::Pass*>::iterator it = passes.begin(); it != passes.end(); it++)
+            pm.add(*it);
+        pm.run(*module);
+    }
+    else
+    {
+        /* One manager per pass so that each one can be timed on its own */
+        if (timeReport != NULL)
+            timeReport->setCounter("ir_instructions", countInstructions(*module));
+        for (std::vector<llvm::Pass*>::iterator it = passes.begin(); it != passes.end(); it++)
+        {
+            std::string name = (*it)->getPassName();
+            llvm::PassManager pm;
+            addTargetAnalyses(pm, targetMachine);
+            pm.add(llvm::createBasicAliasAnalysisPass());
+            pm.add(*it);
+
+            Stopwatch watch;
+            {
+                TraceSpan span("pass", name);
+                pm.run(*module);
+            }
+            if (timeReport != NULL)
+                timeReport->addPass(name, watch.elapsed());
+        }
+        if (timeReport != NULL)
+            timeReport->setCounter("ir_instructions_optimized", countInstructions(*module));
+    }
+
+    if (dumpIR)
+        module->print(llvm::outs(), NULL);
+}
+
+/* Compile a REPL snippet into its own entry function of the current module.
+   The function returns the value of the last statement when that is an
+   int or double, and void otherwise. */
+llvm::Function* CodeGenContext::generateSnippet(Block& root, const std::string& name)
+{
+    llvm::FunctionType *ftype = llvm::FunctionType::get(llvm::Type::getVoidTy(llvmContext), false);
+    llvm::Function *function = llvm::Function::Create(ftype, llvm::GlobalValue::ExternalLinkage, name, module);
+    llvm::BasicBlock *bblock = llvm::BasicBlock::Create(llvmContext, "entry", function, 0);
+    builder.SetInsertPoint(bblock);
+
+    pushBlock(bblock);
+    setFPMode(fpMode);
+    llvm::Value* pRetVal = root.codeGen(*this);
+    popBlock();
+
+    if (pRetVal != NULL && (pRetVal->getType()->isIntegerTy(32) || pRetVal->getType()->isDoubleTy()))
+    {
+        /* The result type is only known now, so move the body over to a
+           function with the right signature */
+        llvm::FunctionType *rtype = llvm::FunctionType::get(pRetVal->getType(), false);
+        llvm::Function *typed = llvm::Function::Create(rtype, llvm::GlobalValue::ExternalLinkage, "", module);
+        typed->getBasicBlockList().splice(typed->begin(), function->getBasicBlockList());
+        typed->takeName(function);
+        function->eraseFromParent();
+        function = typed;
+
+        builder.SetInsertPoint(&function->back());
+        builder.CreateRet(pRetVal);
+    }
+    else
+    {
+        builder.SetInsertPoint(&function->back());
+        builder.CreateRetVoid();
+    }
+
+    return function;
+}
+
+/* Start a fresh module for the next unit of code. Symbols of modules that
+   were published stay reachable through lookupFunction/lookupVariable. */
+void CodeGenContext::newModule(const std::string& name)
+{
+    module = new llvm::Module(name, llvmContext);
+}
+
+/* Make the definitions of the current module visible to later modules */
+void CodeGenContext::publishModule()
+{
+    for (llvm::Module::iterator it = module->begin(); it != module->end(); it++)
+    {
+        if (!it->isDeclaration())
+            externals[it->getName()] = it;
+    }
+
+    for (llvm::Module::global_iterator it = module->global_begin(); it != module->global_end(); it++)
+    {
+        if (!it->isDeclaration())
+            externals[it->getName()] = it;
+    }
+}
+
+/* Find a function in the current module, or declare one that an earlier
+   module defined and bind it to the code the engine already has for it */
+llvm::Function* CodeGenContext::lookupFunction(const std::string& name)
+{
+    llvm::Function *function = module->getFunction(name);
+    if (function != NULL)
+        return function;
 
-    pm.add(llvm::createReassociatePass());
+    std::map<std::string, llvm::GlobalValue*>::iterator it = externals.find(name);
+    if (it == externals.end() || !llvm::isa<llvm::Function>(it->second))
+        return NULL;
+
+    llvm::Function *def = llvm::cast<llvm::Function>(it->second);
+    function = llvm::Function::Create(def->getFunctionType(), llvm::GlobalValue::ExternalLinkage, name, module);
+    function->setCallingConv(def->getCallingConv());
+    if (engine != NULL)
+        engine->addGlobalMapping(function, engine->getPointerToFunction(def));
 
-    pm.add(llvm::createGVNPass());
+    return function;
+}
 
-    pm.add(llvm::createCFGSimplificationPass());
-    pm.add(llvm::createPrintModulePass(&llvm::outs()));
+void SymbolTable::declare(const std::string& name, llvm::Value *value, unsigned int frame)
+{
+    Index::iterator it = index.find(name);
+    if (it == index.end())
+        it = index.insert(Index::value_type(name, -1)).first;
 
-    pm.run(*module);
+    Entry entry = { &*it, value, it->second, frame };
+    it->second = (int)entries.size();
+    entries.push_back(entry);
+}
+
+void SymbolTable::pop()
+{
+    size_t mark = marks.back();
+    marks.pop_back();
+    while (entries.size() > mark)
+    {
+        entries.back().binding->second = entries.back().shadowed;
+        entries.pop_back();
+    }
+}
+
+SymbolTable::Entry* SymbolTable::find(const std::string& name)
+{
+    Index::iterator it = index.find(name);
+    if (it == index.end() || it->second < 0)
+        return NULL;
+    return &entries[it->second];
+}
+
+/* Enter a function; its parameters go into the scope opened here */
+void CodeGenContext::pushBlock(llvm::BasicBlock *block)
+{
+    frames.push_back(CodeGenBlock());
+    frames.back().block = block;
+    symbols.push();
+    frames.back().depth = symbols.depth();
+}
+
+/* Enter the function a statement was outlined into */
+void CodeGenContext::pushOutlinedBlock(llvm::BasicBlock *block, llvm::Value *captureArray)
+{
+    pushBlock(block);
+    frames.back().captureArray = captureArray;
+}
+
+/* Point a name of the current function at a new value, e.g. the stack
+   slot of a parameter that is assigned to */
+void CodeGenContext::rebind(const std::string& name, llvm::Value *value)
+{
+    SymbolTable::Entry *entry = symbols.find(name);
+    if (entry != NULL && entry->frame == frames.size() - 1)
+        entry->value = value;
+}
+
+/* The value of a local as seen from a function. Locals of other functions
+   are only reachable from outlined bodies, which capture them the first
+   time they are used there. */
+llvm::Value* CodeGenContext::capture(unsigned int frame, const SymbolTable::Entry& entry)
+{
+    if (entry.frame == frame)
+        return entry.value;
+
+    CodeGenBlock& block = frames[frame];
+    if (block.captureArray == NULL)
+        return NULL;
+    const std::string *name = &entry.binding->first;
+    for (size_t i = 0; i < block.captured.size(); i++)
+    {
+        if (block.captured[i].first == name)
+            return block.captured[i].second;
+    }
+
+    llvm::Value *outer = capture(frame - 1, entry);
+    if (outer == NULL)
+        return NULL;
+
+    /* Values without an address, i.e. parameters, are passed as a copy */
+    llvm::Type *pType = outer->getType()->isPointerTy() ? outer->getType() : outer->getType()->getPointerTo();
+    llvm::BasicBlock& entryBlock = llvm::cast<llvm::Argument>(block.captureArray)->getParent()->getEntryBlock();
+    llvm::IRBuilder<> builder(&entryBlock, entryBlock.begin());
+    llvm::Value *slot = builder.CreateConstGEP1_32(block.captureArray, (unsigned int)block.captures.size());
+    llvm::Value *pVar = builder.CreateBitCast(builder.CreateLoad(slot), pType, *name);
+
+    block.captures.push_back(outer);
+    block.captured.push_back(std::make_pair(name, pVar));
+    return pVar;
+}
+
+/* Same as lookupFunction for variables; locals in scope win */
+llvm::Value* CodeGenContext::lookupVariable(const std::string& name)
+{
+    SymbolTable::Entry *entry = symbols.find(name);
+    if (entry != NULL)
+    {
+        llvm::Value *local = capture((unsigned int)frames.size() - 1, *entry);
+        if (local != NULL)
+            return local;
+    }
+
+    llvm::GlobalVariable *var = module->getGlobalVariable(name, true);
+    if (var != NULL)
+        return var;
+
+    std::map<std::string, llvm::GlobalValue*>::iterator it = externals.find(name);
+    if (it == externals.end() || !llvm::isa<llvm::GlobalVariable>(it->second))
+        return NULL;
+
+    llvm::GlobalVariable *def = llvm::cast<llvm::GlobalVariable>(it->second);
+    var = new llvm::GlobalVariable(*module, def->getType()->getElementType(), false, 
+                                   llvm::GlobalValue::ExternalLinkage, NULL, name);
+    if (engine != NULL)
+        engine->addGlobalMapping(var, engine->getPointerToGlobal(def));
+
+    return var;
+}
+
+/* JIT for the module with the target of this context; the engine takes
+   ownership of the module */
+llvm::ExecutionEngine* CodeGenContext::createEngine(std::string& err)
+{
+    llvm::TargetOptions options;
+    initTargetOptions(options);
+
+    /* Only MCJIT emits the DWARF sections and registers them through the
+       GDB JIT interface, which reads nothing but ELF objects */
+    bool useMCJIT = (sourceLines != NULL);
+    if (useMCJIT)
+    {
+        options.JITEmitDebugInfo = true;
+        std::string triple = llvm::sys::getProcessTriple();
+#ifdef _WIN32
+        triple += "-elf";
+#endif
+        module->setTargetTriple(triple);
+    }
+
+    llvm::ExecutionEngine *ee = llvm::EngineBuilder(module)
+                                    .setErrorStr(&err)
+                                    .setEngineKind(llvm::EngineKind::JIT)
+                                    .setUseMCJIT(useMCJIT)
+                                    .setTargetOptions(options)
+                                    .setMCPU(target.cpuName())
+                                    .setMAttrs(target.attrs)
+                                    .create();
+    if (ee == NULL)
+        return NULL;
+
+    /* MCJIT notifies the listeners once, when the object is finalized */
+    if (perfMapEnabled())
+        ee->RegisterJITEventListener(perfJITListener());
+    if (traceEnabled())
+        ee->RegisterJITEventListener(traceJITListener());
+    if (useMCJIT)
+        ee->finalizeObject();
+    return ee;
 }
 
 /* Executes the AST by running the main function */
 llvm::GenericValue CodeGenContext::runCode() {
-    std::cout << "Running code...\n";
-    llvm::ExecutionEngine *ee = llvm::EngineBuilder(module).create();
+    log() << "Running code...\n";
+    llvm::ExecutionEngine *ee;
+    {
+        PhaseTimer timer(timeReport, "jit");
+        std::string err;
+        ee = createEngine(err);
+        if (ee == NULL)
+        {
+            error() << "Could not create the JIT: " << err << endl;
+            return llvm::GenericValue();
+        }
+        ee->getPointerToFunction(initFunction);
+    }
+
+    PhaseTimer timer(timeReport, "run");
     vector<llvm::GenericValue> noargs;
-    llvm::GenericValue v = ee->runFunction(mainFunction, noargs);
-    std::cout << "Code was run.\n";
+    llvm::GenericValue v = ee->runFunction(initFunction, noargs);
+    if (profile != NULL)
+        profile->collect(ee);
+    log() << "Code was run.\n";
     return v;
 }
 
+bool parseFPMode(const std::string& name, FPMode& mode)
+{
+    if (name == "strict")
+        mode = FP_STRICT;
+    else if (name == "contract")
+        mode = FP_CONTRACT;
+    else if (name == "fast")
+        mode = FP_FAST;
+    else
+        return false;
+    return true;
+}
+
+/* Switch the FP semantics of the instructions generated from now on */
+void CodeGenContext::setFPMode(FPMode mode)
+{
+    functionFPMode = mode;
+    builder.SetFastMathFlags(fastMathFlags());
+}
+
+llvm::FastMathFlags CodeGenContext::fastMathFlags() const
+{
+    llvm::FastMathFlags flags;
+    if (functionFPMode == FP_FAST)
+        flags.setUnsafeAlgebra();
+    return flags;
+}
+
 /* Returns an LLVM type based on the identifier */
-static llvm::Type *typeOf(const Identifier& type) 
+llvm::Type *typeOf(llvm::LLVMContext& llvmContext, const Identifier& type) 
 {
     if (type.name.compare("int") == 0) {
-        return llvm::Type::getInt32Ty(llvm::getGlobalContext());
+        return llvm::Type::getInt32Ty(llvmContext);
     }
     else if (type.name.compare("double") == 0) {
-        return llvm::Type::getDoubleTy(llvm::getGlobalContext());
+        return llvm::Type::getDoubleTy(llvmContext);
+    }
+    else if (type.name.compare("vec4d") == 0) {
+        return llvm::VectorType::get(llvm::Type::getDoubleTy(llvmContext), 4);
+    }
+    else if (type.name.compare("vec8i") == 0) {
+        return llvm::VectorType::get(llvm::Type::getInt32Ty(llvmContext), 8);
     }
-    return llvm::Type::getVoidTy(llvm::getGlobalContext());
+    return llvm::Type::getVoidTy(llvmContext);
+}
+
+/* MiniC name of a value type, for messages */
+static std::string typeName(llvm::Type *pType)
+{
+    if (pType->isVectorTy())
+        return (pType->getVectorElementType()->isDoubleTy() ? "vec4d" : "vec8i");
+    if (pType->isDoubleTy())
+        return "double";
+    if (pType->isIntegerTy(32))
+        return "int";
+    return "void";
+}
+
+/* Scalars convert between int and double and spread over the lanes of a
+   vector; a vector only converts to a vector with as many lanes */
+bool convertible(llvm::Type *pFrom, llvm::Type *pTo)
+{
+    if (!pFrom->isIntOrIntVectorTy() && !pFrom->isFPOrFPVectorTy())
+        return false;
+    if (!pTo->isIntOrIntVectorTy() && !pTo->isFPOrFPVectorTy())
+        return false;
+    if (!pFrom->isVectorTy())
+        return true;
+    return pTo->isVectorTy() && pTo->getVectorNumElements() == pFrom->getVectorNumElements();
+}
+
+/* Converts between int and double, and broadcasts a scalar to every lane
+   when a vector type is wanted. Reports an error at offset and returns
+   NULL when the value does not convert. */
+llvm::Value* convertTo(CodeGenContext& context, llvm::IRBuilder<>& builder, llvm::Value *pValue, llvm::Type *pType, SourceOffset offset)
+{
+    llvm::Type *pFrom = pValue->getType();
+    if (pFrom == pType)
+        return pValue;
+
+    if (!convertible(pFrom, pType))
+    {
+        context.error(offset) << "cannot convert " << typeName(pFrom) << " to " << typeName(pType) << endl;
+        return NULL;
+    }
+
+    llvm::VectorType *pVecType = llvm::dyn_cast<llvm::VectorType>(pType);
+    if (pVecType != NULL && !pFrom->isVectorTy())
+    {
+        llvm::Value *pScalar = convertTo(context, builder, pValue, pVecType->getElementType(), offset);
+        llvm::Value *pVec = builder.CreateInsertElement(llvm::UndefValue::get(pVecType), pScalar, builder.getInt32(0));
+        llvm::Constant *pZeros = llvm::ConstantAggregateZero::get(llvm::VectorType::get(builder.getInt32Ty(), pVecType->getNumElements()));
+        return builder.CreateShuffleVector(pVec, llvm::UndefValue::get(pVecType), pZeros);
+    }
+
+    if (pFrom->isIntOrIntVectorTy() && pType->isFPOrFPVectorTy())
+        return builder.CreateSIToFP(pValue, pType);
+    if (pFrom->isFPOrFPVectorTy() && pType->isIntOrIntVectorTy())
+        return builder.CreateFPToSI(pValue, pType);
+    return pValue;
 }
 
 /* -- Code Generation -- */
 
 llvm::Value* ConstInt::codeGen(CodeGenContext& context)
 {
-    std::cout << "Creating integer: " << value << endl;
-    return llvm::ConstantInt::get(llvm::Type::getInt32Ty(llvm::getGlobalContext()), value, true);
+    context.log() << "Creating integer: " << value << endl;
+    return llvm::ConstantInt::get(llvm::Type::getInt32Ty(context.llvmContext), value, true);
 }
 
 llvm::Value* ConstDouble::codeGen(CodeGenContext& context)
 {
-    std::cout << "Creating double: " << value << endl;
-    return llvm::ConstantFP::get(llvm::Type::getDoubleTy(llvm::getGlobalContext()), value);
+    context.log() << "Creating double: " << value << endl;
+    return llvm::ConstantFP::get(llvm::Type::getDoubleTy(context.llvmContext), value);
 }
 
 llvm::Value* Identifier::codeGen(CodeGenContext& context)
 {
-    std::cout << "Creating identifier reference: " << name << endl;
+    context.log() << "Creating identifier reference: " << name << endl;
     
-    if (context.locals().find(name) == context.locals().end()) 
+    llvm::Value* pVar = context.lookupVariable(name);
+    if (pVar == NULL) 
     {
-        std::cerr << "undeclared variable " << name << endl;
+        context.error(offset) << "undeclared variable " << name << endl;
         return NULL;
     }
+
+    /* Parameters are SSA values until something assigns to them */
+    if (!pVar->getType()->isPointerTy())
+        return pVar;
     
-    return new llvm::LoadInst(context.locals()[name], "", false, context.currentBlock());
+    return new llvm::LoadInst(pVar, "", false, context.currentBlock());
 }
 
 llvm::Value* MethodCall::codeGen(CodeGenContext& context)
 {
-    llvm::Function *function = context.module->getFunction(id.name.c_str());
+    llvm::Function *function = context.lookupFunction(id.name);
     if (function == NULL) 
     {
-        std::cerr << "no such function " << id.name << endl;
+        bool builtin;
+        llvm::Value *pValue = codeGenBuiltin(context, *this, builtin);
+        if (!builtin)
+            context.error(offset) << "no such function " << id.name << endl;
+        return pValue;
     }
     
     std::vector<llvm::Value*> args;
@@ -107,35 +659,90 @@ llvm::Value* MethodCall::codeGen(CodeGenContext& context)
     }
     
     llvm::CallInst *call = llvm::CallInst::Create(function, llvm::makeArrayRef(args), "", context.currentBlock());
-    std::cout << "Creating method call: " << id.name << endl;
+    call->setCallingConv(function->getCallingConv());
+    if (context.profile != NULL)
+        context.profile->call(call);
+    context.log() << "Creating method call: " << id.name << endl;
     return call;
 }
 
+/* Outside of strict mode a * b + c becomes llvm.fmuladd, which the code
+   generator fuses wherever the target has FMA instructions */
+static llvm::Value* createMulAdd(CodeGenContext& context, llvm::Value* L, llvm::Value* R, bool bSubtract)
+{
+    if (context.currentFPMode() == FP_STRICT)
+        return NULL;
+
+    /* Only a product that feeds nothing else can be folded away */
+    llvm::BinaryOperator* pMul = llvm::dyn_cast<llvm::BinaryOperator>(L);
+    llvm::Value* pAddend = R;
+    if (!bSubtract && (pMul == NULL || pMul->getOpcode() != llvm::Instruction::FMul))
+    {
+        pMul = llvm::dyn_cast<llvm::BinaryOperator>(R);
+        pAddend = L;
+    }
+    if (pMul == NULL || pMul->getOpcode() != llvm::Instruction::FMul || !pMul->use_empty())
+        return NULL;
+
+    if (bSubtract)
+        pAddend = context.builder.CreateFNeg(pAddend);
+    llvm::Function* pFmuladd = llvm::Intrinsic::getDeclaration(context.module, llvm::Intrinsic::fmuladd, pMul->getType());
+    llvm::Value* args[] = { pMul->getOperand(0), pMul->getOperand(1), pAddend };
+    llvm::Value* pResult = context.builder.CreateCall(pFmuladd, args);
+    pMul->eraseFromParent();
+    return pResult;
+}
+
 llvm::Value* BinaryOp::codeGen(CodeGenContext& context)
 {
     llvm::Value* L = lhs.codeGen(context);
     llvm::Value* R = rhs.codeGen(context);
 
-    std::cout << "Creating binary operation " << op << endl;
+    context.log() << "Creating binary operation " << op << endl;
     
     if (L == NULL || R == NULL)
         return NULL;
 
+    /* A scalar operand of a vector operation applies to every lane, and
+       int meets double as a double */
+    llvm::Type* pLType = L->getType();
+    llvm::Type* pRType = R->getType();
+    if (pLType != pRType)
+    {
+        bool bToLeft = pLType->isVectorTy() != pRType->isVectorTy() ? pLType->isVectorTy() : pLType->isFPOrFPVectorTy();
+        if (!convertible(bToLeft ? pRType : pLType, bToLeft ? pLType : pRType))
+        {
+            context.error(offset) << "operands of " << typeName(pLType) << " and " << typeName(pRType) << " do not match" << endl;
+            return NULL;
+        }
+        if (bToLeft)
+            R = convertTo(context, context.builder, R, pLType, offset);
+        else
+            L = convertTo(context, context.builder, L, pRType, offset);
+    }
+
     llvm::Value* pInst = NULL;
+    bool bFloat = L->getType()->isFPOrFPVectorTy();
 
     switch (op) 
     {
         case PLUS: 
-            pInst = g_Builder.CreateAdd(L, R);
+            if (bFloat)
+                pInst = createMulAdd(context, L, R, false);
+            if (pInst == NULL)
+                pInst = bFloat ? context.builder.CreateFAdd(L, R) : context.builder.CreateAdd(L, R);
             break;
         case MINUS:
-            pInst = g_Builder.CreateFSub(L, R);
+            if (bFloat)
+                pInst = createMulAdd(context, L, R, true);
+            if (pInst == NULL)
+                pInst = bFloat ? context.builder.CreateFSub(L, R) : context.builder.CreateSub(L, R);
             break;
         case MUL:
-            pInst = g_Builder.CreateFMul(L, R);
+            pInst = bFloat ? context.builder.CreateFMul(L, R) : context.builder.CreateMul(L, R);
             break;
         case DIV:
-            pInst = g_Builder.CreateFDiv(L, R);
+            pInst = bFloat ? context.builder.CreateFDiv(L, R) : context.builder.CreateSDiv(L, R);
             break;				
         /* TODO comparison */
     }
@@ -145,15 +752,35 @@ llvm::Value* BinaryOp::codeGen(CodeGenContext& context)
 
 llvm::Value* AssignmentExpr::codeGen(CodeGenContext& context)
 {
-    std::cout << "Creating assignment for " << lhs.name << endl;
+    context.log() << "Creating assignment for " << lhs.name << endl;
     
-    if (context.locals().find(lhs.name) == context.locals().end()) 
+    llvm::Value* pVar = context.lookupVariable(lhs.name);
+    if (pVar == NULL) 
     {
-        std::cerr << "undeclared variable " << lhs.name << endl;
+        context.error(offset) << "undeclared variable " << lhs.name << endl;
         return NULL;
     }
+
+    llvm::Argument* pArg = llvm::dyn_cast<llvm::Argument>(pVar);
+    if (pArg != NULL)
+    {
+        /* Move an assigned parameter into a stack slot at the top of the
+           function; uses before this point keep reading the argument */
+        llvm::BasicBlock& entry = pArg->getParent()->getEntryBlock();
+        llvm::IRBuilder<> builder(&entry, entry.begin());
+        llvm::AllocaInst* pSlot = builder.CreateAlloca(pArg->getType(), 0, lhs.name);
+        builder.CreateStore(pArg, pSlot);
+        context.rebind(lhs.name, pSlot);
+        pVar = pSlot;
+    }
     
-    return g_Builder.CreateStore(rhs.codeGen(context), context.locals()[lhs.name], false);
+    llvm::Value* pValue = rhs.codeGen(context);
+    if (pValue == NULL)
+        return NULL;
+    pValue = convertTo(context, context.builder, pValue, llvm::cast<llvm::PointerType>(pVar->getType())->getElementType(), offset);
+    if (pValue == NULL)
+        return NULL;
+    return context.builder.CreateStore(pValue, pVar, false);
 }
 
 llvm::Value* Block::codeGen(CodeGenContext& context)
@@ -161,87 +788,356 @@ llvm::Value* Block::codeGen(CodeGenContext& context)
     StatementList::const_iterator it;
     llvm::Value *last = NULL;
     
+    context.pushScope();
     for (it = statements.begin(); it != statements.end(); it++) 
     {
-        std::cout << "Generating code for " << typeid(**it).name() << endl;
+        context.log() << "Generating code for " << typeid(**it).name() << endl;
+        if (context.debug() != NULL)
+            context.debug()->setLocation(context.builder, (**it).offset);
         last = (**it).codeGen(context);
     }
+    context.popScope();
     
-    std::cout << "Creating block" << endl;
+    context.log() << "Creating block" << endl;
     return last;
 }
 
 llvm::Value* ExprStmt::codeGen(CodeGenContext& context)
 {
-    std::cout << "Generating code for " << typeid(expression).name() << endl;
+    context.log() << "Generating code for " << typeid(expression).name() << endl;
     return expression.codeGen(context);
 }
 
 llvm::Value* VarDecl::codeGen(CodeGenContext& context)
 {
-    std::cout << "Creating variable declaration " << type.name << " " << id.name << endl;
-    llvm::AllocaInst *alloc = g_Builder.CreateAlloca(typeOf(type));
+    context.log() << "Creating variable declaration " << type.name << " " << id.name << endl;
+    /* A snippet run once in a shared JIT keeps its variables on the stack:
+       the JIT never releases the storage of a global */
+    bool snippet = !context.interactive && context.engine != NULL;
+    if (context.atTopLevel() && !snippet)
+        return codeGenGlobal(context);
+
+    llvm::Value *alloc = context.builder.CreateAlloca(typeOf(context.llvmContext, type));
     alloc->setName(id.name.c_str());
-    context.locals()[id.name] = alloc;
+    context.declare(id.name, alloc);
 
     if (assignmentExpr != NULL) 
     {
         AssignmentExpr assn(id, *assignmentExpr);
+        assn.offset = offset;
         llvm::Value* assnVal = assn.codeGen(context);
     }
 
     return alloc;
 }
 
+/* A top level variable is a global. An initializer that folds to a constant
+   is stored in the global itself; any other is computed by the init function. */
+llvm::Value* VarDecl::codeGenGlobal(CodeGenContext& context)
+{
+    llvm::Type *pType = typeOf(context.llvmContext, type);
+    llvm::Value *pValue = NULL;
+    if (assignmentExpr != NULL)
+    {
+        pValue = assignmentExpr->codeGen(context);
+        if (pValue != NULL)
+            pValue = convertTo(context, context.builder, pValue, pType, offset);
+    }
+
+    /* REPL state has to survive the snippet that declared it, and a host
+       reads the globals of exported code */
+    llvm::GlobalValue::LinkageTypes linkage = (context.interactive || context.exportFunctions) ? 
+        llvm::GlobalValue::ExternalLinkage : llvm::GlobalValue::InternalLinkage;
+    llvm::Constant *pInit = llvm::dyn_cast_or_null<llvm::Constant>(pValue);
+    llvm::GlobalVariable *pVar = new llvm::GlobalVariable(*context.module, pType, false, linkage,
+        pInit != NULL ? pInit : llvm::Constant::getNullValue(pType), id.name.c_str());
+
+    if (pValue != NULL && pInit == NULL)
+        context.builder.CreateStore(pValue, pVar, false);
+
+    return pVar;
+}
+
+/* Falling off the end of a function returns the value of its last
+   statement, as it did before there were return statements */
+static llvm::Value* fallThroughValue(CodeGenContext& context, llvm::Value *pValue, llvm::Type *pType)
+{
+    if (pType->isVoidTy())
+        return NULL;
+    if (pValue != NULL && convertible(pValue->getType(), pType))
+        pValue = convertTo(context, context.builder, pValue, pType, NO_OFFSET);
+    if (pValue == NULL || pValue->getType() != pType)
+        return llvm::UndefValue::get(pType);
+    return pValue;
+}
+
 llvm::Value* FuncDecl::codeGen(CodeGenContext& context)
 {
+    TraceSpan span("codegen", id.name);
     vector<llvm::Type*> argTypes;
     VariableList::const_iterator it;
     
     for (it = arguments.begin(); it != arguments.end(); it++) 
     {
-        argTypes.push_back(typeOf((**it).type));
+        argTypes.push_back(typeOf(context.llvmContext, (**it).type));
     }
     
-    llvm::FunctionType *ftype = llvm::FunctionType::get(typeOf(type), llvm::makeArrayRef(argTypes), false);
-    llvm::Function *function = llvm::Function::Create(ftype, llvm::GlobalValue::InternalLinkage, id.name.c_str(), context.module);
-    llvm::BasicBlock *bblock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "entry", function, 0);
-    g_Builder.SetInsertPoint(bblock);
+    llvm::FunctionType *ftype = llvm::FunctionType::get(typeOf(context.llvmContext, type), llvm::makeArrayRef(argTypes), false);
+    llvm::Function *function;
+    if (context.exportFunctions)
+    {
+        function = llvm::Function::Create(ftype, llvm::GlobalValue::ExternalLinkage, id.name.c_str(), context.module);
+    }
+    else
+    {
+        function = llvm::Function::Create(ftype, llvm::GlobalValue::InternalLinkage, id.name.c_str(), context.module);
+        function->setCallingConv(llvm::CallingConv::Fast);   /* only called from MiniC code */
+    }
+    llvm::BasicBlock *bblock = llvm::BasicBlock::Create(context.llvmContext, "entry", function, 0);
+    context.builder.SetInsertPoint(bblock);
     context.pushBlock(bblock);
+    if (context.debug() != NULL)
+        context.debug()->beginFunction(context.builder, function, offset);
+    if (context.profile != NULL)
+        context.profile->functionEntry(function);
+    if (context.counters != NULL)
+        context.counters->functionEntry(function);
 
-    for (it = arguments.begin(); it != arguments.end(); it++) 
+    FPMode outerFPMode = context.currentFPMode();
+    FPMode mode = context.fpMode;
+    if (!fpMode.empty() && !parseFPMode(fpMode, mode))
+        context.error(offset) << "unknown fpmode " << fpMode << " for " << id.name << endl;
+    context.setFPMode(mode);
+
+    /* Arguments are bound by value; see AssignmentExpr for assigned ones */
+    llvm::Function::arg_iterator arg = function->arg_begin();
+    for (it = arguments.begin(); it != arguments.end(); it++, arg++) 
     {
-        (**it).codeGen(context);
+        arg->setName((**it).id.name);
+        context.declare((**it).id.name, arg);
     }
+
+    llvm::Type* pRetType = function->getReturnType();
+    llvm::BasicBlock* pReturnBB = llvm::BasicBlock::Create(context.llvmContext, "return");
+    llvm::AllocaInst* pSlot = pRetType->isVoidTy() ? NULL : context.builder.CreateAlloca(pRetType, 0, "result");
+    context.setReturn(pReturnBB, pSlot);
     
-    llvm::Value* pRetVal = block.codeGen(context);
-    g_Builder.CreateRet(pRetVal);
+    llvm::Value* pRetVal = fallThroughValue(context, block.codeGen(context), pRetType);
+
+    llvm::ReturnInst* pRet;
+    if (pReturnBB->use_empty())
+    {
+        /* Without return statements the function ends where its body does.
+           A call whose value is returned right away can reuse our frame. */
+        llvm::CallInst* pCall = llvm::dyn_cast_or_null<llvm::CallInst>(pRetVal);
+        if (pCall != NULL && pCall == &context.builder.GetInsertBlock()->back() && pCall->getCallingConv() == function->getCallingConv())
+            pCall->setTailCall();
+        pRet = pSlot != NULL ? context.builder.CreateRet(pRetVal) : context.builder.CreateRetVoid();
+        delete pReturnBB;
+        if (pSlot != NULL)
+            pSlot->eraseFromParent();
+    }
+    else
+    {
+        /* Every exit goes through one return block. The block left open by
+           a trailing return is unreachable and dropped instead. */
+        llvm::BasicBlock* pEndBB = context.builder.GetInsertBlock();
+        if (pEndBB->empty() && pEndBB->use_empty() && pEndBB != &function->getEntryBlock())
+        {
+            pEndBB->eraseFromParent();
+        }
+        else
+        {
+            if (pSlot != NULL)
+                context.builder.CreateStore(pRetVal, pSlot);
+            context.builder.CreateBr(pReturnBB);
+        }
+
+        function->getBasicBlockList().push_back(pReturnBB);
+        context.builder.SetInsertPoint(pReturnBB);
+        pRet = pSlot != NULL ? context.builder.CreateRet(context.builder.CreateLoad(pSlot)) : context.builder.CreateRetVoid();
+    }
+    if (context.counters != NULL)
+        context.counters->functionExit(pRet);
+    if (context.debug() != NULL)
+        context.debug()->endFunction(context.builder);
 
     context.popBlock();
+    context.setFPMode(outerFPMode);
 
     llvm::BasicBlock* pPrevBlock = context.currentBlock();
-    g_Builder.SetInsertPoint(pPrevBlock);
+    context.builder.SetInsertPoint(pPrevBlock);
 
-    std::cout << "Creating function: " << id.name << endl;
+    context.log() << "Creating function: " << id.name << endl;
     return function;
 }
 
+llvm::Value* ReturnStmt::codeGen(CodeGenContext& context)
+{
+    llvm::BasicBlock* pReturnBB = context.returnBlock();
+    if (pReturnBB == NULL)
+    {
+        context.error(offset) << "return outside of a function, or in a parallel for" << endl;
+        return NULL;
+    }
+
+    llvm::Value* pSlot = context.returnSlot();
+    if (expression != NULL)
+    {
+        llvm::Value* pValue = expression->codeGen(context);
+        if (pValue == NULL)
+            return NULL;
+        if (pSlot == NULL)
+        {
+            context.error(offset) << "return with a value in a void function" << endl;
+            return NULL;
+        }
+        pValue = convertTo(context, context.builder, pValue, llvm::cast<llvm::PointerType>(pSlot->getType())->getElementType(), offset);
+        if (pValue == NULL)
+            return NULL;
+        context.builder.CreateStore(pValue, pSlot);
+    }
+    else if (pSlot != NULL)
+    {
+        context.error(offset) << "return without a value in a function that returns one" << endl;
+        return NULL;
+    }
+    context.builder.CreateBr(pReturnBB);
+
+    /* Statements after the return get a block nothing branches to,
+       which CFG simplification removes */
+    llvm::Function* pFunction = context.builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock* pDeadBB = llvm::BasicBlock::Create(context.llvmContext, "after.return", pFunction);
+    context.builder.SetInsertPoint(pDeadBB);
+    context.setCurrentBlock(pDeadBB);
+
+    context.log() << "Creating return" << endl;
+    return NULL;
+}
+
 llvm::Value* IfExpr::codeGen(CodeGenContext& context)
 {
     llvm::Value* pCond = expression.codeGen(context);
     if (pCond == NULL)
         return NULL;
 
-    pCond = g_Builder.CreateFCmpONE(pCond,
-                                    llvm::ConstantFP::get(llvm::getGlobalContext(), llvm::APFloat(0.0)),
-                                    "ifcond");
+    if (pCond->getType()->isFloatingPointTy())
+        pCond = context.builder.CreateFCmpONE(pCond, llvm::ConstantFP::get(pCond->getType(), 0.0), "ifcond");
+    else if (!pCond->getType()->isIntegerTy(1))
+        pCond = context.builder.CreateICmpNE(pCond, llvm::Constant::getNullValue(pCond->getType()), "ifcond");
+
+    llvm::Function* pFunction = context.builder.GetInsertBlock()->getParent();
+
+    // Create blocks for the then case and the code after the if. Insert the 'then' block at the end of function
+    llvm::BasicBlock* pThenBB  = llvm::BasicBlock::Create(context.llvmContext, "then", pFunction);
+    llvm::BasicBlock* pMergeBB = llvm::BasicBlock::Create(context.llvmContext, "ifcont");
+
+    llvm::BranchInst* pBranch = context.builder.CreateCondBr(pCond, pThenBB, pMergeBB);
+    if (context.profile != NULL)
+        context.profile->branch(pBranch);
+
+    context.builder.SetInsertPoint(pThenBB);
+    context.setCurrentBlock(pThenBB);
+    m_pBlock->codeGen(context);
+    context.builder.CreateBr(pMergeBB);
+
+    pFunction->getBasicBlockList().push_back(pMergeBB);
+    context.builder.SetInsertPoint(pMergeBB);
+    context.setCurrentBlock(pMergeBB);
+
+    context.log() << "Creating if" << endl;
+    return NULL;
+}
 
-    llvm::Function* pFunction = g_Builder.GetInsertBlock()->getParent();
+llvm::Value* ParallelFor::codeGen(CodeGenContext& context)
+{
+    llvm::LLVMContext& ctx = context.llvmContext;
+    llvm::Type* pIntType = llvm::Type::getInt32Ty(ctx);
+
+    llvm::Value* pLow = m_pLow->codeGen(context);
+    llvm::Value* pHigh = m_pHigh->codeGen(context);
+    llvm::Value* pGrain = m_pGrain != NULL ? m_pGrain->codeGen(context) : llvm::ConstantInt::get(pIntType, 0);
+    if (pLow == NULL || pHigh == NULL || pGrain == NULL)
+        return NULL;
+    pLow = convertTo(context, context.builder, pLow, pIntType, m_pLow->offset);
+    pHigh = convertTo(context, context.builder, pHigh, pIntType, m_pHigh->offset);
+    pGrain = convertTo(context, context.builder, pGrain, pIntType, m_pGrain != NULL ? m_pGrain->offset : offset);
+    if (pLow == NULL || pHigh == NULL || pGrain == NULL)
+        return NULL;
+
+    /* void body(i8** captures, i32 lo, i32 hi) runs one chunk of the loop */
+    llvm::Function* pOuter = context.builder.GetInsertBlock()->getParent();
+    llvm::Type* pCaptureType = llvm::Type::getInt8PtrTy(ctx)->getPointerTo();
+    llvm::Type* argTypes[] = { pCaptureType, pIntType, pIntType };
+    llvm::FunctionType* pBodyType = llvm::FunctionType::get(llvm::Type::getVoidTy(ctx), argTypes, false);
+    llvm::Function* pBody = llvm::Function::Create(pBodyType, llvm::GlobalValue::InternalLinkage, 
+                                                   pOuter->getName() + ".parallel", context.module);
+    llvm::Function::arg_iterator arg = pBody->arg_begin();
+    llvm::Value* pCaptures = arg++;
+    llvm::Value* pChunkLow = arg++;
+    llvm::Value* pChunkHigh = arg++;
+
+    llvm::BasicBlock* pOuterBB = context.builder.GetInsertBlock();
+    llvm::BasicBlock* pEntryBB = llvm::BasicBlock::Create(ctx, "entry", pBody);
+    llvm::BasicBlock* pCondBB  = llvm::BasicBlock::Create(ctx, "cond", pBody);
+    llvm::BasicBlock* pLoopBB  = llvm::BasicBlock::Create(ctx, "loop", pBody);
+    llvm::BasicBlock* pExitBB  = llvm::BasicBlock::Create(ctx, "exit");
+
+    context.pushOutlinedBlock(pEntryBB, pCaptures);
+    context.builder.SetInsertPoint(pEntryBB);
+    if (context.debug() != NULL)
+        context.debug()->beginFunction(context.builder, pBody, offset);
+    llvm::Value* pIndex = context.builder.CreateAlloca(pIntType, 0, var.name);
+    context.builder.CreateStore(pChunkLow, pIndex);
+    context.declare(var.name, pIndex);
+    context.builder.CreateBr(pCondBB);
+
+    context.builder.SetInsertPoint(pCondBB);
+    context.builder.CreateCondBr(context.builder.CreateICmpSLT(context.builder.CreateLoad(pIndex), pChunkHigh), pLoopBB, pExitBB);
+
+    context.builder.SetInsertPoint(pLoopBB);
+    context.setCurrentBlock(pLoopBB);
+    m_pBlock->codeGen(context);
+    context.builder.CreateStore(context.builder.CreateAdd(context.builder.CreateLoad(pIndex), llvm::ConstantInt::get(pIntType, 1)), pIndex);
+    context.builder.CreateBr(pCondBB);
+
+    pBody->getBasicBlockList().push_back(pExitBB);
+    context.builder.SetInsertPoint(pExitBB);
+    context.builder.CreateRetVoid();
+    if (context.debug() != NULL)
+        context.debug()->endFunction(context.builder);
+
+    std::vector<llvm::Value*> captures = context.captures();
+    context.popBlock();
+    context.builder.SetInsertPoint(pOuterBB);
+
+    /* Pass the address of every captured variable; parameters get a copy */
+    llvm::BasicBlock& outerEntry = pOuter->getEntryBlock();
+    llvm::IRBuilder<> entryBuilder(&outerEntry, outerEntry.begin());
+    llvm::Type* pArrayType = llvm::ArrayType::get(llvm::Type::getInt8PtrTy(ctx), captures.empty() ? 1 : captures.size());
+    llvm::Value* pArray = entryBuilder.CreateAlloca(pArrayType, 0, "captures");
+    for (unsigned int i = 0; i < captures.size(); i++)
+    {
+        llvm::Value* pVar = captures[i];
+        if (!pVar->getType()->isPointerTy())
+        {
+            llvm::Value* pCopy = entryBuilder.CreateAlloca(pVar->getType());
+            context.builder.CreateStore(pVar, pCopy);
+            pVar = pCopy;
+        }
+        context.builder.CreateStore(context.builder.CreatePointerCast(pVar, llvm::Type::getInt8PtrTy(ctx)),
+                              context.builder.CreateConstInBoundsGEP2_32(pArray, 0, i));
+    }
 
-    // Create blocks for then and else cases. Insert the 'then' block at the end of function
-    llvm::BasicBlock* pThenBB  = llvm::BasicBlock::Create(llvm::getGlobalContext(), "then", pFunction);
-    llvm::BasicBlock* pElseBB  = llvm::BasicBlock::Create(llvm::getGlobalContext(), "else");
-    llvm::BasicBlock* pMergeBB = llvm::BasicBlock::Create(llvm::getGlobalContext(), "ifcont");
+    registerRuntime();
+    llvm::Type* runtimeArgs[] = { pBody->getType(), pCaptureType, pIntType, pIntType, pIntType };
+    llvm::Constant* pRuntime = context.module->getOrInsertFunction("minic_parallel_for",
+        llvm::FunctionType::get(llvm::Type::getVoidTy(ctx), runtimeArgs, false));
+    llvm::Value* callArgs[] = { pBody, context.builder.CreateConstInBoundsGEP2_32(pArray, 0, 0), pLow, pHigh, pGrain };
+    llvm::CallInst* pCall = context.builder.CreateCall(pRuntime, callArgs);
+    if (context.counters != NULL)
+        context.counters->loop(pCall, pBody->getName(), pLow, pHigh);
 
-    g_Builder.CreateCondBr(pCond, pThenBB, pElseBB);
+    context.log() << "Creating parallel for over " << var.name << endl;
+    return NULL;
 }
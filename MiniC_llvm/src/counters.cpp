@@ -0,0 +1,280 @@
+#include "counters.h"
+#include "codegen.h"
+#include "runtime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+
+#ifdef _MSC_VER
+#define COUNTER_THREAD_LOCAL __declspec(thread)
+#else
+#define COUNTER_THREAD_LOCAL __thread
+#endif
+
+using namespace std;
+
+namespace
+{
+    const unsigned int NO_SLOT = ~0u;
+
+    /* Where every function and loop keeps its counts within a table */
+    struct Registry
+    {
+        std::mutex mutex;
+        std::atomic<bool> enabled;                      /* read without the lock */
+        bool cycles;
+        unsigned int size;                              /* slots per table */
+        unsigned int used;
+        unsigned int uncounted;                         /* left out for lack of slots */
+        unsigned int missingTables;                     /* threads that got the discard table */
+        std::map<std::string, unsigned int> functions;  /* calls, then cycles */
+        std::map<std::string, unsigned int> loops;      /* TRIP_BUCKETS slots */
+        std::map<unsigned int, std::vector<unsigned int> > freed;  /* released slots by run length */
+        std::vector<uint64_t*> tables;                  /* one per thread, never freed */
+        uint64_t *discard;                              /* written when a thread's table cannot be allocated */
+
+        Registry() : enabled(false), cycles(false), size(0), used(0), uncounted(0), missingTables(0), discard(NULL) { }
+
+        /* count consecutive slots for a name, NO_SLOT when the table is full */
+        unsigned int slotOf(std::map<std::string, unsigned int>& slots, const std::string& name, unsigned int count)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::map<std::string, unsigned int>::iterator it = slots.find(name);
+            if (it != slots.end())
+                return it->second;
+
+            unsigned int slot;
+            std::vector<unsigned int>& reusable = freed[count];
+            if (!reusable.empty())
+            {
+                slot = reusable.back();
+                reusable.pop_back();
+            }
+            else if (used + count <= size)
+            {
+                slot = used;
+                used += count;
+            }
+            else
+            {
+                uncounted++;
+                return NO_SLOT;
+            }
+            slots[name] = slot;
+            return slot;
+        }
+
+        /* Zero and free the slots of every name starting with prefix */
+        void release(std::map<std::string, unsigned int>& slots, const std::string& prefix, unsigned int count)
+        {
+            std::map<std::string, unsigned int>::iterator it = slots.lower_bound(prefix);
+            while (it != slots.end() && it->first.compare(0, prefix.size(), prefix) == 0)
+            {
+                for (std::vector<uint64_t*>::iterator table = tables.begin(); table != tables.end(); table++)
+                    std::fill(*table + it->second, *table + it->second + count, 0);
+                freed[count].push_back(it->second);
+                slots.erase(it++);
+            }
+        }
+    };
+
+    Registry s_Registry;
+    COUNTER_THREAD_LOCAL uint64_t *t_pTable = NULL;
+
+    /* Functions and loops of different modules may share a name */
+    std::string counterName(llvm::Module *module, const std::string& name)
+    {
+        return module->getModuleIdentifier() + ":" + name;
+    }
+}
+
+bool enableCounters(bool cycles, unsigned int slots)
+{
+    std::lock_guard<std::mutex> lock(s_Registry.mutex);
+    if (s_Registry.enabled)
+        return true;    /* tables already handed out keep their size */
+    unsigned int size = std::max(slots, TRIP_BUCKETS);
+    s_Registry.discard = (uint64_t *)calloc(size, sizeof(uint64_t));
+    if (s_Registry.discard == NULL)
+        return false;
+    s_Registry.cycles = cycles;
+    s_Registry.size = size;
+    s_Registry.enabled = true;
+    return true;
+}
+
+bool countersEnabled()
+{
+    return s_Registry.enabled;
+}
+
+void releaseCounters(const std::string& module)
+{
+    std::lock_guard<std::mutex> lock(s_Registry.mutex);
+    s_Registry.release(s_Registry.functions, module + ":", 2);
+    s_Registry.release(s_Registry.loops, module + ":", TRIP_BUCKETS);
+}
+
+extern "C" uint64_t* minic_counter_table()
+{
+    if (t_pTable == NULL)
+    {
+        /* calloc'ed pages stay untouched, and cost nothing, until counted in */
+        uint64_t *pTable = (uint64_t *)calloc(s_Registry.size, sizeof(uint64_t));
+        std::lock_guard<std::mutex> lock(s_Registry.mutex);
+        if (pTable == NULL)
+        {
+            /* the thread's counts are lost, but its code still runs */
+            s_Registry.missingTables++;
+            return s_Registry.discard;
+        }
+        t_pTable = pTable;
+        s_Registry.tables.push_back(t_pTable);
+    }
+    return t_pTable;
+}
+
+CounterSnapshot readCounters()
+{
+    CounterSnapshot snapshot;
+    std::lock_guard<std::mutex> lock(s_Registry.mutex);
+    snapshot.uncounted = s_Registry.uncounted;
+    snapshot.missingTables = s_Registry.missingTables;
+    for (std::map<std::string, unsigned int>::iterator it = s_Registry.functions.begin(); it != s_Registry.functions.end(); it++)
+    {
+        FunctionCounts counts = { 0, 0 };
+        for (std::vector<uint64_t*>::iterator table = s_Registry.tables.begin(); table != s_Registry.tables.end(); table++)
+        {
+            counts.calls += (*table)[it->second];
+            counts.cycles += (*table)[it->second + 1];
+        }
+        snapshot.functions[it->first] = counts;
+    }
+    for (std::map<std::string, unsigned int>::iterator it = s_Registry.loops.begin(); it != s_Registry.loops.end(); it++)
+    {
+        std::vector<uint64_t>& trips = snapshot.loops[it->first];
+        trips.assign(TRIP_BUCKETS, 0);
+        for (std::vector<uint64_t*>::iterator table = s_Registry.tables.begin(); table != s_Registry.tables.end(); table++)
+        {
+            for (unsigned int bucket = 0; bucket < TRIP_BUCKETS; bucket++)
+                trips[bucket] += (*table)[it->second + bucket];
+        }
+    }
+    return snapshot;
+}
+
+static bool hotter(const std::pair<std::string, FunctionCounts>& a, const std::pair<std::string, FunctionCounts>& b)
+{
+    if (a.second.cycles != b.second.cycles)
+        return a.second.cycles > b.second.cycles;
+    return a.second.calls > b.second.calls;
+}
+
+void CounterSnapshot::printHot(std::ostream& out, unsigned int top) const
+{
+    std::vector<std::pair<std::string, FunctionCounts> > sorted(functions.begin(), functions.end());
+    std::sort(sorted.begin(), sorted.end(), hotter);
+
+    out << "Hot functions:" << endl;
+    if (uncounted > 0)
+        out << "  (" << uncounted << " functions and loops not counted, out of counter slots)" << endl;
+    if (missingTables > 0)
+        out << "  (counts of " << missingTables << " threads lost, no memory for their tables)" << endl;
+    for (unsigned int i = 0; i < sorted.size() && i < top; i++)
+    {
+        const FunctionCounts& counts = sorted[i].second;
+        out << "  " << sorted[i].first << ": " << counts.calls << " calls";
+        if (counts.cycles > 0)
+            out << ", " << counts.cycles << " cycles, " << counts.cycles / std::max<uint64_t>(counts.calls, 1) << " per call";
+        out << endl;
+    }
+
+    for (std::map<std::string, std::vector<uint64_t> >::const_iterator it = loops.begin(); it != loops.end(); it++)
+    {
+        out << "Trips of " << it->first << ":";
+        for (unsigned int bucket = 0; bucket < it->second.size(); bucket++)
+        {
+            if (it->second[bucket] > 0)
+                out << " [" << (bucket == 0 ? 0 : 1u << bucket) << ".." << ((1ull << (bucket + 1)) - 1) << "] " << it->second[bucket];
+        }
+        out << endl;
+    }
+}
+
+void CounterBuilder::functionEntry(llvm::Function *function)
+{
+    if (!countersEnabled())
+        return;
+
+    registerRuntime();
+    llvm::Module *module = function->getParent();
+    llvm::LLVMContext& ctx = module->getContext();
+    llvm::BasicBlock& entry = function->getEntryBlock();
+    llvm::IRBuilder<> builder(&entry, entry.begin());
+
+    Entry counters;
+    counters.slot = s_Registry.slotOf(s_Registry.functions, counterName(module, function->getName()), 2);
+    if (counters.slot == NO_SLOT)
+        return;
+    llvm::Constant *pTableFunction = module->getOrInsertFunction("minic_counter_table", 
+        llvm::FunctionType::get(llvm::Type::getInt64PtrTy(ctx), false));
+    /* The table of a thread never changes, so the optimizer may treat the
+       lookup as a pure function and share or hoist it */
+    if (llvm::Function *pDecl = llvm::dyn_cast<llvm::Function>(pTableFunction))
+    {
+        pDecl->setDoesNotAccessMemory();
+        pDecl->setDoesNotThrow();
+    }
+    counters.table = builder.CreateCall(pTableFunction, "counters");
+    llvm::Value *pCalls = builder.CreateConstGEP1_32(counters.table, counters.slot);
+    builder.CreateStore(builder.CreateAdd(builder.CreateLoad(pCalls), builder.getInt64(1)), pCalls);
+
+    counters.start = NULL;
+    if (s_Registry.cycles)
+        counters.start = builder.CreateCall(llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::readcyclecounter), "start");
+    entries[function] = counters;
+}
+
+void CounterBuilder::functionExit(llvm::Instruction *ret)
+{
+    std::map<llvm::Function*, Entry>::iterator it = entries.find(ret->getParent()->getParent());
+    if (it == entries.end() || it->second.start == NULL)
+        return;
+
+    /* Stop the clock before a tail call so that it stays one */
+    llvm::Instruction *before = ret;
+    llvm::CallInst *pCall = llvm::dyn_cast_or_null<llvm::CallInst>(ret->getPrevNode());
+    if (pCall != NULL && pCall->isTailCall())
+        before = pCall;
+
+    llvm::IRBuilder<> builder(before);
+    llvm::Value *pEnd = builder.CreateCall(llvm::Intrinsic::getDeclaration(it->first->getParent(), llvm::Intrinsic::readcyclecounter));
+    llvm::Value *pCycles = builder.CreateConstGEP1_32(it->second.table, it->second.slot + 1);
+    builder.CreateStore(builder.CreateAdd(builder.CreateLoad(pCycles), builder.CreateSub(pEnd, it->second.start)), pCycles);
+}
+
+void CounterBuilder::loop(llvm::Instruction *before, const std::string& name, llvm::Value *low, llvm::Value *high)
+{
+    std::map<llvm::Function*, Entry>::iterator it = entries.find(before->getParent()->getParent());
+    if (it == entries.end())
+        return;
+
+    /* bucket = log2(max(high - low, 1)) */
+    llvm::IRBuilder<> builder(before);
+    llvm::Value *trips = builder.CreateSub(high, low);
+    llvm::Type *pType = trips->getType();
+    llvm::Value *pOne = llvm::ConstantInt::get(pType, 1);
+    llvm::Value *pTrips = builder.CreateSelect(builder.CreateICmpSLT(trips, pOne), pOne, trips);
+    llvm::Value *pZeros = builder.CreateCall2(llvm::Intrinsic::getDeclaration(it->first->getParent(), llvm::Intrinsic::ctlz, pType), 
+                                              pTrips, builder.getTrue());
+    llvm::Value *pBucket = builder.CreateSub(llvm::ConstantInt::get(pType, pType->getPrimitiveSizeInBits() - 1), pZeros);
+
+    unsigned int slot = s_Registry.slotOf(s_Registry.loops, counterName(it->first->getParent(), name), TRIP_BUCKETS);
+    if (slot == NO_SLOT)
+        return;
+    llvm::Value *pSlot = builder.CreateAdd(builder.CreateZExtOrTrunc(pBucket, builder.getInt32Ty()), builder.getInt32(slot));
+    llvm::Value *pCount = builder.CreateGEP(it->second.table, pSlot);
+    builder.CreateStore(builder.CreateAdd(builder.CreateLoad(pCount), builder.getInt64(1)), pCount);
+}
@@ -0,0 +1,65 @@
+#include "debuginfo.h"
+
+#include <llvm/Support/Dwarf.h>
+#include <llvm/Support/Path.h>
+
+using namespace std;
+
+DebugInfo::DebugInfo(llvm::Module& module, const SourceMap& lines, const std::string& path, bool optimized)
+    : builder(module), lines(lines), optimized(optimized)
+{
+    llvm::StringRef name = llvm::sys::path::filename(path);
+    llvm::StringRef directory = llvm::sys::path::parent_path(path);
+    builder.createCompileUnit(llvm::dwarf::DW_LANG_C99, name, directory, "MiniC", optimized, "", 0);
+    file = builder.createFile(name, directory);
+}
+
+/* MiniC's scalar types; vectors are left undescribed */
+llvm::DIType DebugInfo::typeOf(llvm::Type *pType)
+{
+    if (pType->isIntegerTy())
+        return builder.createBasicType("int", pType->getPrimitiveSizeInBits(), pType->getPrimitiveSizeInBits(), llvm::dwarf::DW_ATE_signed);
+    if (pType->isDoubleTy())
+        return builder.createBasicType("double", 64, 64, llvm::dwarf::DW_ATE_float);
+    return llvm::DIType();
+}
+
+void DebugInfo::beginFunction(llvm::IRBuilder<>& irBuilder, llvm::Function *function, SourceOffset offset)
+{
+    unsigned int line = 0, column = 0;
+    if (offset != NO_OFFSET)
+        lines.resolve(offset, line, column);
+
+    /* the return type comes first */
+    vector<llvm::Value*> types;
+    types.push_back(typeOf(function->getReturnType()));
+    for (llvm::Function::arg_iterator arg = function->arg_begin(); arg != function->arg_end(); arg++)
+        types.push_back(typeOf(arg->getType()));
+    llvm::DIType type = builder.createSubroutineType(file, builder.getOrCreateArray(types));
+
+    llvm::DISubprogram subprogram = builder.createFunction(file, function->getName(), function->getName(), file, line, type,
+                                                           function->hasInternalLinkage(), true, line,
+                                                           llvm::DIDescriptor::FlagPrototyped, optimized, function);
+    Scope scope;
+    scope.subprogram = subprogram;
+    scope.location = llvm::DebugLoc::get(line, column, subprogram);
+    scopes.push_back(scope);
+    irBuilder.SetCurrentDebugLocation(scope.location);
+}
+
+void DebugInfo::endFunction(llvm::IRBuilder<>& irBuilder)
+{
+    scopes.pop_back();
+    irBuilder.SetCurrentDebugLocation(scopes.empty() ? llvm::DebugLoc() : scopes.back().location);
+}
+
+void DebugInfo::setLocation(llvm::IRBuilder<>& irBuilder, SourceOffset offset)
+{
+    if (offset == NO_OFFSET || scopes.empty())
+        return;
+
+    unsigned int line, column;
+    lines.resolve(offset, line, column);
+    scopes.back().location = llvm::DebugLoc::get(line, column, scopes.back().subprogram);
+    irBuilder.SetCurrentDebugLocation(scopes.back().location);
+}
@@ -0,0 +1,66 @@
+#include "diagnostics.h"
+
+#include <sstream>
+
+using namespace std;
+
+void Diagnostics::add(Diagnostic::Severity severity, SourceOffset offset, const std::string& message)
+{
+    if (severity == Diagnostic::ERROR && errors++ >= maxErrors)
+        return;
+
+    Diagnostic entry;
+    entry.severity = severity;
+    entry.offset = offset;
+    entry.message = message;
+    entries.push_back(entry);
+}
+
+void Diagnostics::error(SourceOffset offset, const std::string& message)
+{
+    add(Diagnostic::ERROR, offset, message);
+}
+
+void Diagnostics::warning(SourceOffset offset, const std::string& message)
+{
+    add(Diagnostic::WARNING, offset, message);
+}
+
+int DiagnosticStream::Buffer::overflow(int c)
+{
+    if (c == traits_type::eof())
+        return traits_type::not_eof(c);
+    if (c != '\n')
+    {
+        line += (char)c;
+        return c;
+    }
+    if (!line.empty())
+        diagnostics.error(offset, line);
+    line.clear();
+    return c;
+}
+
+void Diagnostics::print(std::ostream& out, const std::string& fileName) const
+{
+    for (vector<Diagnostic>::const_iterator it = entries.begin(); it != entries.end(); it++)
+    {
+        out << (fileName.empty() ? "<input>" : fileName);
+        if (it->offset != NO_OFFSET)
+        {
+            unsigned int line, column;
+            lines.resolve(it->offset, line, column);
+            out << "(" << line << "," << column << ")";
+        }
+        out << ": " << (it->severity == Diagnostic::ERROR ? "error" : "warning") << ": " << it->message << endl;
+    }
+    if (errors > maxErrors)
+        out << (errors - maxErrors) << " more errors not shown" << endl;
+}
+
+std::string Diagnostics::str(const std::string& fileName) const
+{
+    ostringstream out;
+    print(out, fileName);
+    return out.str();
+}
@@ -0,0 +1,99 @@
+#include "emit.h"
+#include "codegen.h"
+
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/FormattedStream.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#if defined(LLVM_VERSION_MAJOR) && LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR > 2 
+#include <llvm/IR/DataLayout.h>
+#else
+#include <llvm/DataLayout.h>
+#endif
+
+std::string TargetSelection::cpuName() const
+{
+    return cpu.empty() ? std::string(llvm::sys::getHostCPUName()) : cpu;
+}
+
+std::string TargetSelection::features() const
+{
+    llvm::SubtargetFeatures features;
+    for (std::vector<std::string>::const_iterator it = attrs.begin(); it != attrs.end(); it++)
+        features.AddFeature(*it);
+    return features.getString();
+}
+
+/* Comma separated, as in -mattr=+avx2,-fma */
+void TargetSelection::parseAttrs(const std::string& list)
+{
+    size_t start = 0;
+    while (start < list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        if (end > start)
+            attrs.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+void initTargetOptions(llvm::TargetOptions& options)
+{
+    options.GuaranteedTailCallOpt = true;   /* fastcc calls marked tail never grow the stack */
+    options.AllowFPOpFusion = llvm::FPOpFusion::Standard;
+    options.UnsafeFPMath = false;
+}
+
+/* Callers keep the target machine around, creating one is not cheap.
+   Objects meant for a shared library need position independent code. */
+llvm::TargetMachine* createTargetMachine(const TargetSelection& selection, std::string& err, bool pic)
+{
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, err);
+    if (target == NULL)
+        return NULL;
+
+    llvm::TargetOptions options;
+    initTargetOptions(options);
+    return target->createTargetMachine(triple, selection.cpuName(), selection.features(), options,
+                                       pic ? llvm::Reloc::PIC_ : llvm::Reloc::Default);
+}
+
+llvm::TargetMachine* createHostTargetMachine(std::string& err, bool pic)
+{
+    return createTargetMachine(TargetSelection(), err, pic);
+}
+
+/* Compile the module to a native object file image */
+bool emitObject(llvm::Module& module, llvm::TargetMachine& machine, std::string& out, std::string& err)
+{
+    module.setTargetTriple(machine.getTargetTriple());
+    module.setDataLayout(machine.getDataLayout()->getStringRepresentation());
+
+    llvm::PassManager pm;
+    pm.add(new llvm::DataLayout(*machine.getDataLayout()));
+
+    llvm::raw_string_ostream os(out);
+    {
+        llvm::formatted_raw_ostream fos(os);
+        if (machine.addPassesToEmitFile(pm, fos, llvm::TargetMachine::CGFT_ObjectFile))
+        {
+            err = "target does not support object file emission";
+            return false;
+        }
+        pm.run(module);
+    }
+    os.flush();
+    return true;
+}
+
+void emitBitcode(llvm::Module& module, std::string& out)
+{
+    llvm::raw_string_ostream os(out);
+    llvm::WriteBitcodeToFile(&module, os);
+    os.flush();
+}
@@ -0,0 +1,139 @@
+#include "frontend.h"
+#include "node.h"
+#include "parser.h"
+#include "diagnostics.h"
+
+extern int yyparse();
+extern int yylex();
+extern void yyrestart(FILE *input_file);
+extern unsigned int lineNo;
+extern SourceOffset inputOffset;
+extern SourceMap sourceLines;
+extern Block* programBlock;
+extern bool parseFailed;
+extern Diagnostics *parseDiagnostics;
+
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+typedef unsigned int yy_size_t;
+extern YY_BUFFER_STATE yy_scan_string(const char *yy_str);
+extern YY_BUFFER_STATE yy_scan_buffer(char *base, yy_size_t size);
+extern void yy_delete_buffer(YY_BUFFER_STATE b);
+
+/* Positions restart at the beginning of every input */
+static void resetPosition()
+{
+    lineNo = 1;
+    inputOffset = 0;
+    sourceLines.clear();
+}
+
+/* Run the parser over the current input; a failed parse yields NULL */
+static Block* parse()
+{
+    programBlock = NULL;
+    parseFailed = false;
+    resetPosition();
+    if (yyparse() != 0 || parseFailed)
+        return NULL;
+    return programBlock;
+}
+
+Block* parseFile(FILE *file)
+{
+    yyrestart(file);    /* also drops the buffer left at EOF by a previous file */
+    return parse();
+}
+
+Block* parseString(const std::string& source)
+{
+    YY_BUFFER_STATE buffer = yy_scan_string(source.c_str());
+    Block *root = parse();
+    yy_delete_buffer(buffer);
+    return root;
+}
+
+Block* parseBuffer(char *text, size_t length)
+{
+    /* returns NULL when the padding is missing */
+    YY_BUFFER_STATE buffer = yy_scan_buffer(text, (yy_size_t)(length + SCAN_PADDING));
+    if (buffer == NULL)
+        return NULL;
+    Block *root = parse();
+    yy_delete_buffer(buffer);   /* the text itself belongs to the caller */
+    return root;
+}
+
+/* Sends the syntax errors of one parse to a collector instead of stdout,
+   together with the line table to place them */
+struct DiagnosticsScope
+{
+    Diagnostics& diagnostics;
+
+    DiagnosticsScope(Diagnostics& diagnostics) : diagnostics(diagnostics) { parseDiagnostics = &diagnostics; }
+    ~DiagnosticsScope() { parseDiagnostics = NULL; diagnostics.lines.swap(sourceLines); }
+};
+
+Block* parseFile(FILE *file, Diagnostics& diagnostics)
+{
+    DiagnosticsScope scope(diagnostics);
+    return parseFile(file);
+}
+
+Block* parseString(const std::string& source, Diagnostics& diagnostics)
+{
+    DiagnosticsScope scope(diagnostics);
+    return parseString(source);
+}
+
+Block* parseBuffer(char *text, size_t length, Diagnostics& diagnostics)
+{
+    DiagnosticsScope scope(diagnostics);
+    return parseBuffer(text, length);
+}
+
+/* Count tokens, freeing the strings the lexer allocates for the parser */
+static unsigned long countTokens()
+{
+    unsigned long tokens = 0;
+    int token;
+    while ((token = yylex()) != 0)
+    {
+        if (token == IDENTIFIER || token == INTEGER_CONSTANT || token == DOUBLE_CONSTANT)
+            delete yylval.string;
+        tokens++;
+    }
+    return tokens;
+}
+
+unsigned long lexFile(FILE *file)
+{
+    yyrestart(file);
+    unsigned long tokens = countTokens();
+
+    rewind(file);
+    yyrestart(file);
+    resetPosition();
+    return tokens;
+}
+
+unsigned long lexString(const std::string& source)
+{
+    YY_BUFFER_STATE buffer = yy_scan_string(source.c_str());
+    unsigned long tokens = countTokens();
+
+    yy_delete_buffer(buffer);
+    resetPosition();
+    return tokens;
+}
+
+unsigned long lexBuffer(char *text, size_t length)
+{
+    YY_BUFFER_STATE buffer = yy_scan_buffer(text, (yy_size_t)(length + SCAN_PADDING));
+    if (buffer == NULL)
+        return 0;
+    unsigned long tokens = countTokens();
+
+    yy_delete_buffer(buffer);
+    resetPosition();
+    return tokens;
+}
@@ -286,14 +286,16 @@ static void yy_fatal_error YY_PROTO(( yyconst char msg[] ));
 	*yy_cp = '\0'; \
 	yy_c_buf_p = yy_cp;
 
-#define YY_NUM_RULES 26
-#define YY_END_OF_BUFFER 27
-static yyconst short int yy_accept[36] =
+#define YY_NUM_RULES 30
+#define YY_END_OF_BUFFER 31
+static yyconst short int yy_accept[58] =
     {   0,
-        0,    0,   27,   25,    2,    1,   25,   14,   15,   22,
-       20,   19,   21,   18,   23,    6,   24,   10,    7,   12,
-        4,    4,   16,   17,    1,    9,    5,    6,   11,    8,
-       13,    4,    3,    5,    0
+        0,    0,   31,   29,    2,    1,   29,   18,   19,   26,
+       24,   23,   25,   22,   27,   10,   28,   14,   11,   16,
+        8,    8,    8,    8,    8,   20,   21,    2,   13,    9,
+       10,   15,   12,   17,    8,    8,    8,    3,    8,    8,
+        9,    5,    8,    8,    8,    8,    8,    8,    8,    8,
+        8,    6,    8,    7,    8,    4,    0
     } ;
 
 static yyconst int yy_ec[256] =
@@ -307,11 +309,11 @@ static yyconst int yy_ec[256] =
        16,   17,    1,    1,   18,   18,   18,   18,   18,   18,
        18,   18,   18,   18,   18,   18,   18,   18,   18,   18,
        18,   18,   18,   18,   18,   18,   18,   18,   18,   18,
-        1,    1,    1,    1,   18,    1,   18,   18,   18,   18,
+        1,    1,    1,    1,   18,    1,   19,   18,   18,   20,
 
-       18,   19,   18,   18,   20,   18,   18,   18,   18,   18,
-       18,   18,   18,   18,   18,   18,   18,   18,   18,   18,
-       18,   18,   21,    1,   22,    1,    1,    1,    1,    1,
+       21,   22,   18,   18,   23,   18,   18,   24,   25,   26,
+       27,   28,   18,   29,   18,   30,   31,   18,   18,   18,
+       18,   18,   32,    1,   33,    1,    1,    1,    1,    1,
         1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
         1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
         1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
@@ -328,47 +330,64 @@ static yyconst int yy_ec[256] =
         1,    1,    1,    1,    1
     } ;
 
-static yyconst int yy_meta[23] =
+static yyconst int yy_meta[34] =
     {   0,
-        1,    1,    2,    1,    1,    1,    1,    1,    1,    1,
-        1,    1,    3,    1,    1,    1,    1,    3,    3,    3,
-        1,    1
+        1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
+        1,    1,    2,    1,    1,    1,    1,    2,    2,    2,
+        2,    2,    2,    2,    2,    2,    2,    2,    2,    2,
+        2,    1,    1
     } ;
 
-static yyconst short int yy_base[38] =
+static yyconst short int yy_base[59] =
     {   0,
-        0,    0,   37,   38,   38,    0,   20,   38,   38,   38,
-       38,   38,   38,   38,   38,   12,   38,   19,   18,   17,
-        0,   13,   38,   38,    0,   38,   18,   13,   38,   38,
-       38,    0,    0,   17,   38,   26,   25
+        0,    0,   67,   68,   64,   68,   49,   68,   68,   68,
+       68,   68,   68,   68,   68,   23,   68,   48,   47,   46,
+        0,   10,   39,   41,   38,   68,   68,   56,   68,   44,
+       28,   68,   68,   68,    0,   27,   30,    0,   25,   23,
+       39,    0,   24,   31,   18,   28,   23,   17,   24,   20,
+       17,    0,   21,    0,   16,    0,   68,   33
     } ;
 
-static yyconst short int yy_def[38] =
+static yyconst short int yy_def[59] =
     {   0,
-       35,    1,   35,   35,   35,   36,   35,   35,   35,   35,
-       35,   35,   35,   35,   35,   35,   35,   35,   35,   35,
-       37,   37,   35,   35,   36,   35,   35,   35,   35,   35,
-       35,   37,   37,   35,    0,   35,   35
+       57,    1,   57,   57,   57,   57,   57,   57,   57,   57,
+       57,   57,   57,   57,   57,   57,   57,   57,   57,   57,
+       58,   58,   58,   58,   58,   57,   57,   57,   57,   57,
+       57,   57,   57,   57,   58,   58,   58,   58,   58,   58,
+       57,   58,   58,   58,   58,   58,   58,   58,   58,   58,
+       58,   58,   58,   58,   58,   58,    0,   57
     } ;
 
-static yyconst short int yy_nxt[61] =
+static yyconst short int yy_nxt[102] =
     {   0,
         4,    5,    6,    7,    8,    9,   10,   11,   12,   13,
-       14,   15,   16,   17,   18,   19,   20,   21,   21,   22,
-       23,   24,   27,   27,   28,   28,   25,   32,   25,   34,
-       34,   33,   31,   30,   29,   26,   35,    3,   35,   35,
-       35,   35,   35,   35,   35,   35,   35,   35,   35,   35,
-       35,   35,   35,   35,   35,   35,   35,   35,   35,   35
+       14,   15,   16,   17,   18,   19,   20,   21,   21,   21,
+       21,   22,   23,   21,   21,   21,   21,   24,   25,   21,
+       21,   26,   27,   30,   35,   31,   36,   37,   30,   56,
+       31,   55,   54,   53,   52,   51,   50,   49,   48,   47,
+       46,   41,   45,   44,   43,   42,   41,   28,   40,   39,
+       38,   34,   33,   32,   29,   28,   57,    3,   57,   57,
+       57,   57,   57,   57,   57,   57,   57,   57,   57,   57,
+       57,   57,   57,   57,   57,   57,   57,   57,   57,   57,
+       57,   57,   57,   57,   57,   57,   57,   57,   57,   57,
+
+       57
     } ;
 
-static yyconst short int yy_chk[61] =
+static yyconst short int yy_chk[102] =
     {   0,
         1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
         1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
-        1,    1,   16,   28,   16,   28,   36,   37,   36,   34,
-       27,   22,   20,   19,   18,    7,    3,   35,   35,   35,
-       35,   35,   35,   35,   35,   35,   35,   35,   35,   35,
-       35,   35,   35,   35,   35,   35,   35,   35,   35,   35
+        1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
+        1,    1,    1,   16,   58,   16,   22,   22,   31,   55,
+       31,   53,   51,   50,   49,   48,   47,   46,   45,   44,
+       43,   41,   40,   39,   37,   36,   30,   28,   25,   24,
+       23,   20,   19,   18,    7,    5,    3,   57,   57,   57,
+       57,   57,   57,   57,   57,   57,   57,   57,   57,   57,
+       57,   57,   57,   57,   57,   57,   57,   57,   57,   57,
+       57,   57,   57,   57,   57,   57,   57,   57,   57,   57,
+
+       57
     } ;
 
 static yy_state_type yy_last_accepting_state;
@@ -395,12 +414,21 @@ char *yytext;
 #define YY_NEVER_INTERACTIVE 1 
 #define isatty _isatty
 
-char linebuf[50];
 unsigned int lineNo = 1;
+SourceOffset inputOffset = 0;   /* of the next character to scan */
+SourceMap sourceLines;          /* of the input being scanned */
 
 extern void yyerror(char *s);
+extern YYLTYPE yylloc;
 
-#line 404 "lexer.cpp"
+/* Every token tells the parser where it is */
+#define YY_USER_ACTION \
+    yylloc.first_line = yylloc.last_line = lineNo; \
+    yylloc.first_column = inputOffset; \
+    inputOffset += yyleng; \
+    yylloc.last_column = inputOffset;
+
+#line 432 "lexer.cpp"
 
 /* Macros after this point can all be overridden by user definitions in
  * section 1.
@@ -551,10 +579,10 @@ YY_DECL
 	register char *yy_cp, *yy_bp;
 	register int yy_act;
 
-#line 22 "..\\grammar\\lexer.l"
+#line 31 "..\\grammar\\lexer.l"
 
 
-#line 558 "lexer.cpp"
+#line 586 "lexer.cpp"
 
 	if ( yy_init )
 		{
@@ -605,13 +633,13 @@ yy_match:
 			while ( yy_chk[yy_base[yy_current_state] + yy_c] != yy_current_state )
 				{
 				yy_current_state = (int) yy_def[yy_current_state];
-				if ( yy_current_state >= 36 )
+				if ( yy_current_state >= 58 )
 					yy_c = yy_meta[(unsigned int) yy_c];
 				}
 			yy_current_state = yy_nxt[yy_base[yy_current_state] + (unsigned int) yy_c];
 			++yy_cp;
 			}
-		while ( yy_base[yy_current_state] != 38 );
+		while ( yy_base[yy_current_state] != 68 );
 
 yy_find_action:
 		yy_act = yy_accept[yy_current_state];
@@ -639,139 +667,155 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 24 "..\\grammar\\lexer.l"
-{ 
-                            strncpy(linebuf, yytext+1, sizeof(linebuf)); /* save the next line */
-                            yyless(1);      /* give back all but the \n to rescan */                            
-                            ++lineNo;
-                        }
+#line 33 "..\\grammar\\lexer.l"
+++lineNo; sourceLines.newLine(inputOffset);
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 30 "..\\grammar\\lexer.l"
+#line 35 "..\\grammar\\lexer.l"
 ;
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 32 "..\\grammar\\lexer.l"
+#line 37 "..\\grammar\\lexer.l"
 return TOKEN(IF);
 	YY_BREAK
 case 4:
 YY_RULE_SETUP
-#line 34 "..\\grammar\\lexer.l"
-SAVE_TOKEN; return IDENTIFIER;
+#line 38 "..\\grammar\\lexer.l"
+return TOKEN(PARALLEL);
 	YY_BREAK
 case 5:
 YY_RULE_SETUP
-#line 35 "..\\grammar\\lexer.l"
-SAVE_TOKEN; return DOUBLE_CONSTANT;
+#line 39 "..\\grammar\\lexer.l"
+return TOKEN(FOR);
 	YY_BREAK
 case 6:
 YY_RULE_SETUP
-#line 36 "..\\grammar\\lexer.l"
-SAVE_TOKEN; return INTEGER_CONSTANT;
+#line 40 "..\\grammar\\lexer.l"
+return TOKEN(FPMODE);
 	YY_BREAK
 case 7:
 YY_RULE_SETUP
-#line 37 "..\\grammar\\lexer.l"
-return TOKEN(EQUAL);
+#line 41 "..\\grammar\\lexer.l"
+return TOKEN(RETURN);
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 38 "..\\grammar\\lexer.l"
-return TOKEN(CEQ);
+#line 43 "..\\grammar\\lexer.l"
+SAVE_TOKEN; return IDENTIFIER;
 	YY_BREAK
 case 9:
 YY_RULE_SETUP
-#line 39 "..\\grammar\\lexer.l"
-return TOKEN(CNE);
+#line 44 "..\\grammar\\lexer.l"
+SAVE_TOKEN; return DOUBLE_CONSTANT;
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 40 "..\\grammar\\lexer.l"
-return TOKEN(CLT);
+#line 45 "..\\grammar\\lexer.l"
+SAVE_TOKEN; return INTEGER_CONSTANT;
 	YY_BREAK
 case 11:
 YY_RULE_SETUP
-#line 41 "..\\grammar\\lexer.l"
-return TOKEN(CLE);
+#line 46 "..\\grammar\\lexer.l"
+return TOKEN(EQUAL);
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 42 "..\\grammar\\lexer.l"
-return TOKEN(CGT);
+#line 47 "..\\grammar\\lexer.l"
+return TOKEN(CEQ);
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 43 "..\\grammar\\lexer.l"
-return TOKEN(CGE);
+#line 48 "..\\grammar\\lexer.l"
+return TOKEN(CNE);
 	YY_BREAK
 case 14:
 YY_RULE_SETUP
-#line 44 "..\\grammar\\lexer.l"
-return TOKEN(LPAREN);
+#line 49 "..\\grammar\\lexer.l"
+return TOKEN(CLT);
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 45 "..\\grammar\\lexer.l"
-return TOKEN(RPAREN);
+#line 50 "..\\grammar\\lexer.l"
+return TOKEN(CLE);
 	YY_BREAK
 case 16:
 YY_RULE_SETUP
-#line 46 "..\\grammar\\lexer.l"
-return TOKEN(LBRACE);
+#line 51 "..\\grammar\\lexer.l"
+return TOKEN(CGT);
 	YY_BREAK
 case 17:
 YY_RULE_SETUP
-#line 47 "..\\grammar\\lexer.l"
-return TOKEN(RBRACE);
+#line 52 "..\\grammar\\lexer.l"
+return TOKEN(CGE);
 	YY_BREAK
 case 18:
 YY_RULE_SETUP
-#line 48 "..\\grammar\\lexer.l"
-return TOKEN(DOT);
+#line 53 "..\\grammar\\lexer.l"
+return TOKEN(LPAREN);
 	YY_BREAK
 case 19:
 YY_RULE_SETUP
-#line 49 "..\\grammar\\lexer.l"
-return TOKEN(COMMA);
+#line 54 "..\\grammar\\lexer.l"
+return TOKEN(RPAREN);
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 50 "..\\grammar\\lexer.l"
-return TOKEN(PLUS);
+#line 55 "..\\grammar\\lexer.l"
+return TOKEN(LBRACE);
 	YY_BREAK
 case 21:
 YY_RULE_SETUP
-#line 51 "..\\grammar\\lexer.l"
-return TOKEN(MINUS);
+#line 56 "..\\grammar\\lexer.l"
+return TOKEN(RBRACE);
 	YY_BREAK
 case 22:
 YY_RULE_SETUP
-#line 52 "..\\grammar\\lexer.l"
-return TOKEN(MUL);
+#line 57 "..\\grammar\\lexer.l"
+return TOKEN(DOT);
 	YY_BREAK
 case 23:
 YY_RULE_SETUP
-#line 53 "..\\grammar\\lexer.l"
-return TOKEN(DIV);
+#line 58 "..\\grammar\\lexer.l"
+return TOKEN(COMMA);
 	YY_BREAK
 case 24:
 YY_RULE_SETUP
-#line 54 "..\\grammar\\lexer.l"
-return TOKEN(SEMICOLON);
+#line 59 "..\\grammar\\lexer.l"
+return TOKEN(PLUS);
 	YY_BREAK
 case 25:
 YY_RULE_SETUP
-#line 56 "..\\grammar\\lexer.l"
-printf("Unknown token!\n"); yyterminate();
+#line 60 "..\\grammar\\lexer.l"
+return TOKEN(MINUS);
 	YY_BREAK
 case 26:
 YY_RULE_SETUP
-#line 57 "..\\grammar\\lexer.l"
+#line 61 "..\\grammar\\lexer.l"
+return TOKEN(MUL);
+	YY_BREAK
+case 27:
+YY_RULE_SETUP
+#line 62 "..\\grammar\\lexer.l"
+return TOKEN(DIV);
+	YY_BREAK
+case 28:
+YY_RULE_SETUP
+#line 63 "..\\grammar\\lexer.l"
+return TOKEN(SEMICOLON);
+	YY_BREAK
+case 29:
+YY_RULE_SETUP
+#line 65 "..\\grammar\\lexer.l"
+yyerror("unknown character");
+	YY_BREAK
+case 30:
+YY_RULE_SETUP
+#line 66 "..\\grammar\\lexer.l"
 ECHO;
 	YY_BREAK
-#line 775 "lexer.cpp"
+#line 819 "lexer.cpp"
 case YY_STATE_EOF(INITIAL):
 	yyterminate();
 
@@ -1063,7 +1107,7 @@ static yy_state_type yy_get_previous_state()
 		while ( yy_chk[yy_base[yy_current_state] + yy_c] != yy_current_state )
 			{
 			yy_current_state = (int) yy_def[yy_current_state];
-			if ( yy_current_state >= 36 )
+			if ( yy_current_state >= 58 )
 				yy_c = yy_meta[(unsigned int) yy_c];
 			}
 		yy_current_state = yy_nxt[yy_base[yy_current_state] + (unsigned int) yy_c];
@@ -1098,11 +1142,11 @@ yy_state_type yy_current_state;
 	while ( yy_chk[yy_base[yy_current_state] + yy_c] != yy_current_state )
 		{
 		yy_current_state = (int) yy_def[yy_current_state];
-		if ( yy_current_state >= 36 )
+		if ( yy_current_state >= 58 )
 			yy_c = yy_meta[(unsigned int) yy_c];
 		}
 	yy_current_state = yy_nxt[yy_base[yy_current_state] + (unsigned int) yy_c];
-	yy_is_jam = (yy_current_state == 35);
+	yy_is_jam = (yy_current_state == 57);
 
 	return yy_is_jam ? 0 : yy_current_state;
 	}
@@ -1657,5 +1701,5 @@ int main()
 	return 0;
 	}
 #endif
-#line 57 "..\\grammar\\lexer.l"
+#line 66 "..\\grammar\\lexer.l"
 
@@ -1,33 +1,356 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
 #include "codegen.h"
 #include "node.h"
+#include "repl.h"
+#include "server.h"
+#include "frontend.h"
+#include "timereport.h"
+#include "trace.h"
+#include "tiering.h"
+#include "profile.h"
+#include "diagnostics.h"
+#include "perfmap.h"
+#include "counters.h"
+
+#include <llvm/Support/ManagedStatic.h>
 
 using namespace std;
 
-extern int yyparse();
-extern FILE *yyin;
-extern Block* programBlock;
+
+static bool readSource(const char *path, std::string& source)
+{
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (!in)
+        return false;
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    source = contents.str();
+    return true;
+}
+
+static unsigned int requestKind(const char *flag)
+{
+    if (strcmp(flag, "-bc") == 0)
+        return REQUEST_BITCODE;
+    if (strcmp(flag, "-obj") == 0)
+        return REQUEST_OBJECT;
+    return REQUEST_RUN;
+}
+
+static void usage(const char *name)
+{
+    cout << "Usage: " << name << " [-time-report[=text|json]] [-time-report-file <path>] [-trace <path>] [-tier[=calls]]" << endl
+         << "       " << std::string(strlen(name), ' ') << " [-profile-generate <path> | -profile-use <path>] [-inline-threshold=<n>]" << endl
+         << "       " << std::string(strlen(name), ' ') << " [-fp-mode=strict|contract|fast] [-mcpu=<cpu>] [-mattr=<+feature,-feature>]" << endl
+         << "       " << std::string(strlen(name), ' ') << " [-g] [-perf-map] [-jitdump] [-counters[=cycles]] [-verify | -no-verify]" << endl
+         << "       " << std::string(strlen(name), ' ') << " [-emit-obj <path>] <file>..." << endl
+         << "       " << name << " -repl" << endl
+         << "       " << name << " -server <socket>" << endl
+         << "       " << name << " -client <socket> -run|-bc|-obj <file>" << endl
+         << "       " << name << " -bench-server <socket> -run|-bc|-obj <file> [iterations]" << endl;
+}
 
 int main(int argc, char **argv)
 {
-    FILE *inpFile = fopen(argv[1], "r");
-    if (!inpFile)
+    if (argc < 2)
+    {
+        usage(argv[0]);
+        return -1;
+    }
+
+    if (strcmp(argv[1], "-repl") == 0)
+    {
+        ReplSession session;
+        return session.run(cin, cout);
+    }
+
+    if (strcmp(argv[1], "-server") == 0 && argc == 3)
+    {
+        CompileServer server;
+        return server.run(argv[2]);
+    }
+
+    if ((strcmp(argv[1], "-client") == 0 && argc == 5) || 
+        (strcmp(argv[1], "-bench-server") == 0 && (argc == 5 || argc == 6)))
+    {
+        std::string source;
+        if (!readSource(argv[4], source))
+        {
+            cout << "Error opening File" << endl;
+            return -1;
+        }
+
+        if (strcmp(argv[1], "-client") == 0)
+            return runClient(argv[2], requestKind(argv[3]), source);
+        return benchServer(argv[2], requestKind(argv[3]), source, argc == 6 ? atoi(argv[5]) : 1000);
+    }
+
+    /* Options for compiling files */
+    enum { REPORT_NONE, REPORT_TEXT, REPORT_JSON } reportFormat = REPORT_NONE;
+    const char *reportFile = NULL;
+    const char *traceFile = NULL;
+    unsigned int tierThreshold = 0;
+    const char *profileFile = NULL;
+    bool profileGenerate = false;
+    unsigned int inlineThreshold = DEFAULT_INLINE_THRESHOLD;
+    FPMode fpMode = FP_STRICT;
+    TargetSelection target;
+    const char *objectFile = NULL;
+    bool debugInfo = false;
+    unsigned int perfOutputs = 0;
+    bool counters = false;
+    bool verify = DEFAULT_VERIFY;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if (strcmp(argv[arg], "-time-report") == 0 || strcmp(argv[arg], "-time-report=text") == 0)
+            reportFormat = REPORT_TEXT;
+        else if (strcmp(argv[arg], "-time-report=json") == 0)
+            reportFormat = REPORT_JSON;
+        else if (strcmp(argv[arg], "-time-report-file") == 0 && arg + 1 < argc)
+            reportFile = argv[++arg];
+        else if (strcmp(argv[arg], "-trace") == 0 && arg + 1 < argc)
+            traceFile = argv[++arg];
+        else if ((strcmp(argv[arg], "-profile-generate") == 0 || strcmp(argv[arg], "-profile-use") == 0) && arg + 1 < argc)
+        {
+            profileGenerate = strcmp(argv[arg], "-profile-generate") == 0;
+            profileFile = argv[++arg];
+        }
+        else if (strncmp(argv[arg], "-inline-threshold=", 18) == 0)
+            inlineThreshold = atoi(argv[arg] + 18);
+        else if (strncmp(argv[arg], "-fp-mode=", 9) == 0)
+        {
+            if (!parseFPMode(argv[arg] + 9, fpMode))
+            {
+                usage(argv[0]);
+                return -1;
+            }
+        }
+        else if (strncmp(argv[arg], "-mcpu=", 6) == 0)
+            target.cpu = argv[arg] + 6;
+        else if (strncmp(argv[arg], "-mattr=", 7) == 0)
+            target.parseAttrs(argv[arg] + 7);
+        else if (strcmp(argv[arg], "-g") == 0)
+            debugInfo = true;
+        else if (strcmp(argv[arg], "-perf-map") == 0)
+            perfOutputs |= PERF_MAP;
+        else if (strcmp(argv[arg], "-jitdump") == 0)
+            perfOutputs |= PERF_JITDUMP;
+        else if (strcmp(argv[arg], "-counters") == 0 || strcmp(argv[arg], "-counters=cycles") == 0)
+        {
+            counters = true;
+            if (!enableCounters(strcmp(argv[arg], "-counters=cycles") == 0))
+            {
+                cout << "Not enough memory for the counters" << endl;
+                return -1;
+            }
+        }
+        else if (strcmp(argv[arg], "-verify") == 0)
+            verify = true;
+        else if (strcmp(argv[arg], "-no-verify") == 0)
+            verify = false;
+        else if (strcmp(argv[arg], "-emit-obj") == 0 && arg + 1 < argc)
+            objectFile = argv[++arg];
+        else if (strcmp(argv[arg], "-tier") == 0)
+            tierThreshold = 1000;
+        else if (strncmp(argv[arg], "-tier=", 6) == 0 && atoi(argv[arg] + 6) > 0)
+            tierThreshold = atoi(argv[arg] + 6);
+        else
+            break;
+    }
+
+    if (arg >= argc)
+    {
+        usage(argv[0]);
+        return -1;
+    }
+
+    /* Every input would be written to the same object file */
+    if (objectFile != NULL && argc - arg > 1)
+    {
+        cout << "-emit-obj takes a single input file" << endl;
+        return -1;
+    }
+
+    /* Profile counters are only read back after a run on the plain JIT */
+    if (profileGenerate && (tierThreshold > 0 || objectFile != NULL))
     {
-        cout << "Error opening File" << endl;
+        cout << "-profile-generate cannot be combined with -tier or -emit-obj" << endl;
         return -1;
     }
 
-    yyin = inpFile;
+    if (traceFile != NULL)
+        enableTrace();
+    if (perfOutputs != 0 && !enablePerfMap(perfOutputs))
+        cout << "Could not create the perf map or jitdump in /tmp" << endl;
+
+    Profile profile;
+    if (profileFile != NULL && !profileGenerate && !profile.read(profileFile))
+    {
+        cout << "Could not read profile " << profileFile << endl;
+        return -1;
+    }
+
+    TimeReport report;
+    TimeReport *pReport = reportFormat != REPORT_NONE ? &report : NULL;
+
+    /* LLVM's own table covers the passes of the JIT's code generator */
+    llvm::TimePassesIsEnabled = (reportFormat == REPORT_TEXT);
 
-    yyparse();
-    std::cout << programBlock << endl;
     // see http://comments.gmane.org/gmane.comp.compilers.llvm.devel/33877
-    llvm::InitializeNativeTarget();
-    CodeGenContext context;
-    context.generateCode(*programBlock);
-    context.runCode();
+    {
+        PhaseTimer timer(pReport, "init");
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+    }
+
+    std::string err;
+    llvm::TargetMachine *machine = createTargetMachine(target, err);
+    if (machine == NULL)
+    {
+        cout << "No target machine: " << err << endl;
+        return -1;
+    }
+    cout << "Target " << machine->getTargetTriple() << ", cpu " << target.cpuName() << endl;
+
+    unsigned long tokens = 0;
+    unsigned long nodes = Node::created;
+    int failedFiles = 0;
+    for (; arg < argc; arg++)
+    {
+        TraceSpan span("file", argv[arg]);
+
+        FILE *inpFile = fopen(argv[arg], "r");
+        if (!inpFile)
+        {
+            cout << "Error opening File " << argv[arg] << endl;
+            failedFiles++;
+            continue;
+        }
+
+        if (pReport != NULL)
+        {
+            PhaseTimer timer(pReport, "lex");
+            tokens += lexFile(inpFile);
+        }
+
+        Block *root;
+        Diagnostics diagnostics;
+        {
+            PhaseTimer timer(pReport, "parse");
+            root = parseFile(inpFile, diagnostics);
+        }
+        fclose(inpFile);
+
+        /* A file with errors is reported and skipped, the others still run */
+        std::cout << root << endl;
+        diagnostics.print(cout, argv[arg]);
+        diagnostics.clear();
+        if (root == NULL)
+        {
+            failedFiles++;
+            continue;
+        }
+
+        /* Semantic errors are located in the file like syntax errors */
+        DiagnosticStream semantic(diagnostics);
+        CodeGenContext context;
+        context.module->setModuleIdentifier(argv[arg]);
+        context.diagnostics = &semantic;
+        context.timeReport = pReport;
+        context.inlineThreshold = inlineThreshold;
+        context.fpMode = fpMode;
+        context.verifyCode = verify;
+        context.target = target;
+        context.targetMachine = machine;
+        if (debugInfo)
+        {
+            context.sourceLines = &diagnostics.lines;
+            context.sourcePath = argv[arg];
+        }
+        CounterBuilder counterBuilder;
+        if (counters)
+            context.counters = &counterBuilder;
+        ProfileBuilder profileBuilder(profile, profileGenerate);
+        if (profileFile != NULL)
+            context.profile = &profileBuilder;
+
+        /* The optimizing tier runs its own passes on hot functions only */
+        if (tierThreshold > 0 && objectFile == NULL)
+            context.optimizeCode = false;
+        bool generated = context.generateCode(*root);
+        diagnostics.print(cout, argv[arg]);
+        diagnostics.clear();
+        if (!generated)
+        {
+            failedFiles++;
+            continue;
+        }
+
+        if (objectFile != NULL)
+        {
+            std::string object;
+            if (!emitObject(*context.module, *machine, object, err))
+            {
+                cout << "Could not emit object: " << err << endl;
+                delete machine;
+                return -1;
+            }
+            std::ofstream out(objectFile, std::ios::out | std::ios::binary);
+            out.write(object.data(), object.size());
+            continue;
+        }
+
+        if (tierThreshold == 0)
+        {
+            context.runCode();
+            diagnostics.print(cout, argv[arg]);
+            continue;
+        }
+
+        TieredEngine tiers(context.module, tierThreshold);
+        if (!tiers.valid())
+        {
+            delete machine;
+            return -1;
+        }
+        PhaseTimer timer(pReport, "run");
+        tiers.run(context.entryFunction());
+    }
+    delete machine;
+
+    if (counters)
+        readCounters().printHot(cout, 10);
+
+    if (pReport != NULL)
+    {
+        report.setCounter("tokens", tokens);
+        report.setCounter("ast_nodes", Node::created - nodes);
+        report.setCounter("peak_rss_kb", peakResidentKB());
+
+        std::ofstream file;
+        if (reportFile != NULL)
+            file.open(reportFile);
+        std::ostream& out = reportFile != NULL ? (std::ostream&)file : std::cerr;
+        if (reportFormat == REPORT_JSON)
+            report.printJSON(out);
+        else
+            report.print(out);
+
+        /* flushes LLVM's pass timers */
+        llvm::llvm_shutdown();
+    }
+
+    if (profileGenerate && !profile.write(profileFile))
+        cout << "Could not write profile to " << profileFile << endl;
+
+    if (traceFile != NULL && !writeTrace(traceFile))
+        cout << "Could not write trace to " << traceFile << endl;
     
     system("pause");
-    return 0;
+    return failedFiles > 0 ? -1 : 0;
 }
-
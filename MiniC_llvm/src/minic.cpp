@@ -0,0 +1,167 @@
+#include "minic.h"
+#include "codegen.h"
+#include "node.h"
+#include "frontend.h"
+#include "nullstream.h"
+#include "counters.h"
+
+#include <atomic>
+#include <sstream>
+
+using namespace std;
+
+/* The lexer and parser generated by flex and bison keep their state in globals */
+static std::mutex s_ParseMutex;
+
+/* Keeps the identifiers, and with them the counter names, of modules apart */
+static std::atomic<unsigned int> s_ModuleCount(0);
+
+CompiledModule::~CompiledModule()
+{
+    std::string name = initFunction->getParent()->getModuleIdentifier();
+    delete engine;
+    delete llvmContext;
+    releaseCounters(name);
+}
+
+void* CompiledModule::lookup(const std::string& name)
+{
+    llvm::Function *function = engine->FindFunctionNamed(name.c_str());
+    if (function == NULL || function->isDeclaration())
+        return NULL;
+    return engine->getPointerToFunction(function);
+}
+
+void* CompiledModule::global(const std::string& name)
+{
+    llvm::GlobalVariable *var = initFunction->getParent()->getGlobalVariable(name);
+    if (var == NULL || var->isDeclaration())
+        return NULL;
+    return engine->getPointerToGlobal(var);
+}
+
+void CompiledModule::run()
+{
+    vector<llvm::GenericValue> noargs;
+    engine->runFunction(initFunction, noargs);
+}
+
+Compiler::Compiler()
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();   /* MCJIT, for debug info */
+}
+
+Compiler::~Compiler()
+{
+    for (std::map<std::string, llvm::TargetMachine*>::iterator it = machines.begin(); it != machines.end(); it++)
+        delete it->second;
+}
+
+/* Target machines are only read by the optimizer, so one per CPU is shared */
+llvm::TargetMachine* Compiler::targetMachine(const CompileOptions& options, std::string& err)
+{
+    TargetSelection selection;
+    selection.cpu = options.cpu;
+    selection.attrs = options.attrs;
+    std::string key = selection.cpuName() + " " + selection.features();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, llvm::TargetMachine*>::iterator it = machines.find(key);
+    if (it != machines.end())
+        return it->second;
+
+    llvm::TargetMachine *machine = createTargetMachine(selection, err);
+    if (machine != NULL)
+        machines[key] = machine;
+    return machine;
+}
+
+/* The syntax tree is only needed until compile() returns, so it lives in
+   an arena released right after */
+CompiledModule* Compiler::compileString(const std::string& source, const CompileOptions& options, Diagnostics& diagnostics)
+{
+    NodeArena nodes;
+    Block *root;
+    {
+        std::lock_guard<std::mutex> lock(s_ParseMutex);
+        NodeArena::Use use(nodes);
+        root = parseString(source, diagnostics);
+    }
+    return root != NULL ? compile(*root, options, diagnostics) : NULL;
+}
+
+CompiledModule* Compiler::compileBuffer(char *text, size_t length, const CompileOptions& options, Diagnostics& diagnostics)
+{
+    NodeArena nodes;
+    Block *root;
+    {
+        std::lock_guard<std::mutex> lock(s_ParseMutex);
+        NodeArena::Use use(nodes);
+        root = parseBuffer(text, length, diagnostics);
+    }
+    return root != NULL ? compile(*root, options, diagnostics) : NULL;
+}
+
+CompiledModule* Compiler::compile(Block& root, const CompileOptions& options, Diagnostics& diagnostics)
+{
+    FPMode fpMode;
+    if (!parseFPMode(options.fpMode, fpMode))
+    {
+        diagnostics.error(NO_OFFSET, "unknown fp mode " + options.fpMode);
+        return NULL;
+    }
+
+    std::string err;
+    llvm::TargetMachine *machine = targetMachine(options, err);
+    if (machine == NULL)
+    {
+        diagnostics.error(NO_OFFSET, "no target machine: " + err);
+        return NULL;
+    }
+
+    unsigned int errorsBefore = diagnostics.errorCount();
+    llvm::LLVMContext *llvmContext = new llvm::LLVMContext();
+    NullStream quiet;
+    DiagnosticStream semantic(diagnostics);
+    CodeGenContext context(*llvmContext);
+    std::ostringstream moduleName;
+    moduleName << options.sourceName << "#" << s_ModuleCount++;
+    context.module->setModuleIdentifier(moduleName.str());
+    context.logStream = &quiet;
+    context.diagnostics = &semantic;
+    context.dumpIR = false;
+    context.exportFunctions = true;
+    context.verifyCode = true;      /* invalid code must never reach the JIT, even in release builds */
+    context.optimizeCode = options.optimize;
+    context.inlineThreshold = options.inlineThreshold;
+    context.fpMode = fpMode;
+    context.target.cpu = options.cpu;
+    context.target.attrs = options.attrs;
+    context.targetMachine = machine;
+    if (options.debugInfo)
+    {
+        context.sourceLines = &diagnostics.lines;
+        context.sourcePath = options.sourceName;
+    }
+    CounterBuilder counterBuilder;
+    if (options.counters)
+        context.counters = &counterBuilder;
+    context.generateCode(root);
+
+    llvm::ExecutionEngine *engine = NULL;
+    if (diagnostics.errorCount() == errorsBefore)
+    {
+        engine = context.createEngine(err);
+        if (engine == NULL)
+            diagnostics.error(NO_OFFSET, "could not create the JIT: " + err);
+    }
+    if (engine == NULL)
+    {
+        delete context.module;
+        delete llvmContext;
+        return NULL;
+    }
+
+    return new CompiledModule(llvmContext, engine, context.entryFunction());
+}
@@ -4,6 +4,8 @@
 
 #define YYBISON 1  /* Identify Bison output.  */
 
+#define YYLSP_NEEDED
+
 #define	IDENTIFIER	258
 #define	INTEGER_CONSTANT	259
 #define	DOUBLE_CONSTANT	260
@@ -32,25 +34,41 @@
 #define	CHAR	283
 #define	VOID	284
 #define	IF	285
+#define	PARALLEL	286
+#define	FOR	287
+#define	FPMODE	288
+#define	RETURN	289
 
 
 	#include "node.h"
     #include <cstdio>
     #include <cstdlib>
+    #include "diagnostics.h"
 	Block *programBlock; /* the top level root node of our final AST */
 
 	extern int yylex();
 
-	extern unsigned int lineNo;
 	extern char *yytext;
-	extern char linebuf[50];
+	extern YYLTYPE yylloc;
+
+	bool parseFailed;                           /* set by every error of the current parse */
+	Diagnostics *parseDiagnostics = NULL;       /* collects the errors instead of printing them */
 
     void yyerror(char *s)
     {
-         printf("Line %d: %s at %s in this line:\n%s\n",
-                lineNo, s, yytext, linebuf);
-		 system("pause");
-		 exit(1);
+         std::string message = std::string(s) + " at '" + yytext + "'";
+         parseFailed = true;
+         if (parseDiagnostics != NULL)
+             parseDiagnostics->error(yylloc.first_column, message);
+         else
+             printf("Line %d: %s\n", yylloc.first_line, message.c_str());
+    }
+
+    /* Stamp a node with the offset of the first token of its rule */
+    template <class T> T* at(T *node, const YYLTYPE& location)
+    {
+        node->offset = location.first_column;
+        return node;
     }
 
 typedef union {
@@ -98,11 +116,11 @@ typedef
 
 
 
-#define	YYFINAL		55
+#define	YYFINAL		90
 #define	YYFLAG		-32768
-#define	YYNTBASE	31
+#define	YYNTBASE	35
 
-#define YYTRANSLATE(x) ((unsigned)(x) <= 285 ? yytranslate[x] : 43)
+#define YYTRANSLATE(x) ((unsigned)(x) <= 289 ? yytranslate[x] : 50)
 
 static const char yytranslate[] = {     0,
      2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
@@ -133,118 +151,164 @@ static const char yytranslate[] = {     0,
      2,     2,     2,     2,     2,     1,     2,     3,     4,     5,
      6,     7,     8,     9,    10,    11,    12,    13,    14,    15,
     16,    17,    18,    19,    20,    21,    22,    23,    24,    25,
-    26,    27,    28,    29,    30
+    26,    27,    28,    29,    30,    31,    32,    33,    34
 };
 
 #if YYDEBUG != 0
 static const short yyprhs[] = {     0,
-     0,     2,     4,     7,    10,    12,    14,    18,    21,    24,
-    29,    36,    37,    39,    43,    45,    47,    49,    53,    58,
-    60,    62,    66,    70,    71,    73,    77,    79,    81,    83,
-    85,    87,    89,    91,    93,    95,    97
+     0,     2,     4,     7,    10,    12,    14,    16,    18,    20,
+    23,    27,    30,    34,    37,    42,    49,    60,    61,    63,
+    67,    69,    71,    73,    77,    82,    84,    86,    90,    94,
+    95,    97,   101,   103,   105,   107,   109,   111,   113,   115,
+   117,   119,   121,   125,   128,   134,   145
 };
 
-static const short yyrhs[] = {    32,
-     0,    33,     0,    32,    33,     0,    35,    19,     0,    36,
-     0,    40,     0,    15,    32,    16,     0,    15,    16,     0,
-    38,    38,     0,    38,    38,     6,    40,     0,    38,    38,
-    13,    37,    14,    34,     0,     0,    35,     0,    37,    17,
-    35,     0,     3,     0,     4,     0,     5,     0,    38,     6,
-    40,     0,    38,    13,    41,    14,     0,    38,     0,    39,
-     0,    40,    42,    40,     0,    13,    40,    14,     0,     0,
-    40,     0,    41,    17,    40,     0,     7,     0,     8,     0,
-     9,     0,    10,     0,    11,     0,    12,     0,    20,     0,
-    21,     0,    22,     0,    23,     0,    30,    13,    40,    14,
-    34,     0
+static const short yyrhs[] = {    36,
+     0,    37,     0,    36,    37,     0,    39,    19,     0,    40,
+     0,    48,     0,    49,     0,    47,     0,    44,     0,     1,
+    19,     0,    15,    36,    16,     0,    15,    16,     0,    15,
+     1,    16,     0,    42,    42,     0,    42,    42,     6,    44,
+     0,    42,    42,    13,    41,    14,    38,     0,    42,    42,
+    13,    41,    14,    33,    13,    42,    14,    38,     0,     0,
+    39,     0,    41,    17,    39,     0,     3,     0,     4,     0,
+     5,     0,    42,     6,    44,     0,    42,    13,    45,    14,
+     0,    42,     0,    43,     0,    44,    46,    44,     0,    13,
+    44,    14,     0,     0,    44,     0,    45,    17,    44,     0,
+     7,     0,     8,     0,     9,     0,    10,     0,    11,     0,
+    12,     0,    20,     0,    21,     0,    22,     0,    23,     0,
+    34,    44,    19,     0,    34,    19,     0,    30,    13,    44,
+    14,    38,     0,    31,    32,    13,    42,     6,    44,    19,
+    44,    14,    38,     0,    31,    32,    13,    42,     6,    44,
+    19,    44,    19,    44,    14,    38,     0
 };
 
 #endif
 
 #if YYDEBUG != 0
 static const short yyrline[] = { 0,
-    71,    74,    75,    78,    79,    80,    83,    84,    87,    88,
-    91,    95,    96,    97,   100,   103,   104,   107,   108,   109,
-   110,   111,   112,   115,   116,   117,   120,   120,   120,   120,
-   120,   120,   121,   121,   121,   121,   124
+    83,    86,    87,    90,    91,    92,    93,    94,    95,    96,
+    99,   100,   101,   104,   105,   108,   110,   114,   115,   116,
+   119,   122,   123,   126,   127,   128,   129,   130,   131,   134,
+   135,   136,   139,   139,   139,   139,   139,   139,   140,   140,
+   140,   140,   143,   144,   147,   149,   151
 };
 
 static const char * const yytname[] = {   "$","error","$undefined.","IDENTIFIER",
 "INTEGER_CONSTANT","DOUBLE_CONSTANT","EQUAL","CEQ","CNE","CLT","CLE","CGT","CGE",
 "LPAREN","RPAREN","LBRACE","RBRACE","COMMA","DOT","SEMICOLON","PLUS","MINUS",
-"MUL","DIV","INT","FLOAT","DOUBLE","BOOL","CHAR","VOID","IF","program","stmts",
-"stmt","block","var_decl","func_decl","func_decl_args","ident","numeric","expr",
-"call_args","comparison","\37777777735\37777777735\37777777735\37777777735\37777777735\37777777735\37777777735\37777777735\37777777735\37777777735\37777777735\37777777735"
+"MUL","DIV","INT","FLOAT","DOUBLE","BOOL","CHAR","VOID","IF","PARALLEL","FOR",
+"FPMODE","RETURN","program","stmts","stmt","block","var_decl","func_decl","func_decl_args",
+"ident","numeric","expr","call_args","comparison","return_stmt","if_expr","parallel_for",
+""
 };
 #endif
 
 static const short yyr1[] = {     0,
-    31,    32,    32,    33,    33,    33,    34,    34,    35,    35,
-    36,    37,    37,    37,    38,    39,    39,    40,    40,    40,
-    40,    40,    40,    41,    41,    41,    42,    42,    42,    42,
-    42,    42,    42,    42,    42,    42,    -1
+    35,    36,    36,    37,    37,    37,    37,    37,    37,    37,
+    38,    38,    38,    39,    39,    40,    40,    41,    41,    41,
+    42,    43,    43,    44,    44,    44,    44,    44,    44,    45,
+    45,    45,    46,    46,    46,    46,    46,    46,    46,    46,
+    46,    46,    47,    47,    48,    49,    49
 };
 
 static const short yyr2[] = {     0,
-     1,     1,     2,     2,     1,     1,     3,     2,     2,     4,
-     6,     0,     1,     3,     1,     1,     1,     3,     4,     1,
-     1,     3,     3,     0,     1,     3,     1,     1,     1,     1,
-     1,     1,     1,     1,     1,     1,     5
+     1,     1,     2,     2,     1,     1,     1,     1,     1,     2,
+     3,     2,     3,     2,     4,     6,    10,     0,     1,     3,
+     1,     1,     1,     3,     4,     1,     1,     3,     3,     0,
+     1,     3,     1,     1,     1,     1,     1,     1,     1,     1,
+     1,     1,     3,     2,     5,    10,    12
 };
 
 static const short yydefact[] = {     0,
-    15,    16,    17,     0,     1,     2,     0,     5,    20,    21,
-     6,    20,     0,     3,     4,     0,    24,     9,    27,    28,
-    29,    30,    31,    32,    33,    34,    35,    36,     0,    23,
-    18,    25,     0,     0,    12,    22,    19,     0,    10,    13,
-     0,     0,    26,     0,     0,     9,     0,    11,    14,     8,
-     0,     7,     0,     0,     0
+     0,    21,    22,    23,     0,     0,     0,     0,     0,     2,
+     0,     5,    26,    27,     9,     8,     6,     7,    10,    26,
+     0,     0,     0,    44,     0,     3,     4,     0,    30,    14,
+    33,    34,    35,    36,    37,    38,    39,    40,    41,    42,
+     0,    29,     0,     0,    43,    24,    31,     0,     0,    18,
+    28,     0,     0,    25,     0,    15,    19,     0,     0,     0,
+    45,     0,    32,     0,     0,    14,     0,    12,     0,     0,
+     0,    16,    20,    13,    11,     0,     0,     0,     0,     0,
+     0,     0,    46,     0,    17,     0,    47,     0,     0,     0
 };
 
-static const short yydefgoto[] = {    53,
-     5,     6,    48,     7,     8,    41,    12,    10,    11,    33,
-    29
+static const short yydefgoto[] = {    88,
+     9,    10,    61,    11,    12,    58,    20,    14,    15,    48,
+    41,    16,    17,    18
 };
 
-static const short yypact[] = {    21,
--32768,-32768,-32768,    21,    21,-32768,   -13,-32768,     1,-32768,
-    62,    -5,    45,-32768,-32768,    21,    21,    16,-32768,-32768,
--32768,-32768,-32768,-32768,-32768,-32768,-32768,-32768,    21,-32768,
-    62,    62,    22,    21,    10,    62,-32768,    21,    62,-32768,
-    24,    10,    62,    17,    10,    34,     7,-32768,-32768,-32768,
-    14,-32768,    43,    44,-32768
+static const short yypact[] = {    83,
+   -13,-32768,-32768,-32768,    26,    -3,   -12,    88,    11,-32768,
+     3,-32768,    65,-32768,   213,-32768,-32768,-32768,-32768,    20,
+   128,    26,    34,-32768,   145,-32768,-32768,    26,    26,    45,
+-32768,-32768,-32768,-32768,-32768,-32768,-32768,-32768,-32768,-32768,
+    26,-32768,   162,    50,-32768,   213,   213,    -9,    26,    50,
+   213,    41,    51,-32768,    26,   213,-32768,    18,    50,    33,
+-32768,    26,   213,    10,    50,    60,    36,-32768,    69,   179,
+    63,-32768,-32768,-32768,-32768,    26,    50,   111,    67,    41,
+    26,    41,-32768,   196,-32768,    41,-32768,    79,    89,-32768
 };
 
 static const short yypgoto[] = {-32768,
-     2,    -3,-32768,   -14,-32768,-32768,     0,-32768,    -1,-32768,
--32768
+    23,    -7,   -63,   -47,-32768,-32768,     0,-32768,    -1,-32768,
+-32768,-32768,-32768,-32768
 };
 
 
-#define	YYLAST		85
-
-
-static const short yytable[] = {     9,
-    16,    14,    13,     1,     9,    15,    16,    17,    18,     1,
-     2,     3,     1,    17,    31,    32,     1,     2,     3,     4,
-    40,    34,    50,     1,     2,     3,     4,    36,    35,    52,
-    49,    47,    39,     4,    42,    37,    43,    44,    38,    34,
-    45,    46,    54,    55,    42,     0,     9,    14,    51,     0,
-     9,    19,    20,    21,    22,    23,    24,     0,    30,     0,
-     0,     0,     0,     0,    25,    26,    27,    28,    19,    20,
-    21,    22,    23,    24,     0,     0,     0,     0,     0,     0,
-     0,    25,    26,    27,    28
+#define	YYLAST		236
+
+
+static const short yytable[] = {    13,
+    72,    26,    57,    21,    54,    19,    25,    55,    13,    22,
+    -1,     1,    30,     2,     3,     4,    83,    73,    85,    23,
+    43,    27,    87,     5,    60,    28,    46,    47,     2,     3,
+     4,    64,    29,    67,    65,     2,     3,     4,     5,    51,
+     6,     7,    71,    53,     8,     5,    44,    56,    68,    59,
+    49,    74,     2,    63,    19,    60,    62,    50,    66,    13,
+    70,    26,     6,     7,    59,    49,     8,     2,    13,     1,
+    28,     2,     3,     4,    78,    77,    79,    29,    89,    84,
+    82,     5,    69,     1,    75,     2,     3,     4,    90,     0,
+     2,     3,     4,     0,     0,     5,     0,     0,     6,     7,
+     5,     0,     8,     0,     0,     0,    24,     0,     0,     0,
+     0,     0,     6,     7,     0,     0,     8,    31,    32,    33,
+    34,    35,    36,     0,    80,     0,     0,     0,     0,    81,
+    37,    38,    39,    40,    31,    32,    33,    34,    35,    36,
+     0,    42,     0,     0,     0,     0,     0,    37,    38,    39,
+    40,    31,    32,    33,    34,    35,    36,     0,     0,     0,
+     0,     0,     0,    45,    37,    38,    39,    40,    31,    32,
+    33,    34,    35,    36,     0,    52,     0,     0,     0,     0,
+     0,    37,    38,    39,    40,    31,    32,    33,    34,    35,
+    36,     0,     0,     0,     0,     0,     0,    76,    37,    38,
+    39,    40,    31,    32,    33,    34,    35,    36,     0,    86,
+     0,     0,     0,     0,     0,    37,    38,    39,    40,    31,
+    32,    33,    34,    35,    36,     0,     0,     0,     0,     0,
+     0,     0,    37,    38,    39,    40
 };
 
 static const short yycheck[] = {     0,
-     6,     5,     4,     3,     5,    19,     6,    13,     9,     3,
-     4,     5,     3,    13,    16,    17,     3,     4,     5,    13,
-    35,     6,    16,     3,     4,     5,    13,    29,    13,    16,
-    45,    15,    34,    13,    35,    14,    38,    14,    17,     6,
-    17,    42,     0,     0,    45,    -1,    47,    51,    47,    -1,
-    51,     7,     8,     9,    10,    11,    12,    -1,    14,    -1,
-    -1,    -1,    -1,    -1,    20,    21,    22,    23,     7,     8,
-     9,    10,    11,    12,    -1,    -1,    -1,    -1,    -1,    -1,
-    -1,    20,    21,    22,    23
+    64,     9,    50,     5,    14,    19,     8,    17,     9,    13,
+     0,     1,    13,     3,     4,     5,    80,    65,    82,    32,
+    22,    19,    86,    13,    15,     6,    28,    29,     3,     4,
+     5,    14,    13,     1,    17,     3,     4,     5,    13,    41,
+    30,    31,    33,    44,    34,    13,    13,    49,    16,    50,
+     6,    16,     3,    55,    19,    15,     6,    13,    59,    60,
+    62,    69,    30,    31,    65,     6,    34,     3,    69,     1,
+     6,     3,     4,     5,    76,    13,    77,    13,     0,    81,
+    14,    13,    60,     1,    16,     3,     4,     5,     0,    -1,
+     3,     4,     5,    -1,    -1,    13,    -1,    -1,    30,    31,
+    13,    -1,    34,    -1,    -1,    -1,    19,    -1,    -1,    -1,
+    -1,    -1,    30,    31,    -1,    -1,    34,     7,     8,     9,
+    10,    11,    12,    -1,    14,    -1,    -1,    -1,    -1,    19,
+    20,    21,    22,    23,     7,     8,     9,    10,    11,    12,
+    -1,    14,    -1,    -1,    -1,    -1,    -1,    20,    21,    22,
+    23,     7,     8,     9,    10,    11,    12,    -1,    -1,    -1,
+    -1,    -1,    -1,    19,    20,    21,    22,    23,     7,     8,
+     9,    10,    11,    12,    -1,    14,    -1,    -1,    -1,    -1,
+    -1,    20,    21,    22,    23,     7,     8,     9,    10,    11,
+    12,    -1,    -1,    -1,    -1,    -1,    -1,    19,    20,    21,
+    22,    23,     7,     8,     9,    10,    11,    12,    -1,    14,
+    -1,    -1,    -1,    -1,    -1,    20,    21,    22,    23,     7,
+     8,     9,    10,    11,    12,    -1,    -1,    -1,    -1,    -1,
+    -1,    -1,    20,    21,    22,    23
 };
 /* -*-C-*-  Note some compilers choke on comments on `#line' lines.  */
 
@@ -742,73 +806,97 @@ case 1:
 { programBlock = yyvsp[0].block; ;
     break;}
 case 2:
-{ yyval.block = new Block(); yyval.block->statements.push_back(yyvsp[0].stmt); ;
+{ yyval.block = at(new Block(), yylsp[0]); if (yyvsp[0].stmt != NULL) yyval.block->statements.push_back(yyvsp[0].stmt); ;
     break;}
 case 3:
-{ yyvsp[-1].block->statements.push_back(yyvsp[0].stmt); ;
+{ if (yyvsp[0].stmt != NULL) yyvsp[-1].block->statements.push_back(yyvsp[0].stmt); ;
     break;}
 case 6:
-{ yyval.stmt = new ExprStmt(*yyvsp[0].expr); ;
-    break;}
-case 7:
-{ yyval.block = yyvsp[-1].block; ;
-    break;}
-case 8:
-{ yyval.block = new Block(); ;
+{ yyval.stmt = yyvsp[0].if_expr; ;
     break;}
 case 9:
-{ yyval.stmt = new VarDecl(*yyvsp[-1].ident, *yyvsp[0].ident); ;
+{ yyval.stmt = at(new ExprStmt(*yyvsp[0].expr), yylsp[0]); ;
     break;}
 case 10:
-{ yyval.stmt = new VarDecl(*yyvsp[-3].ident, *yyvsp[-2].ident, yyvsp[0].expr); ;
+{ yyval.stmt = NULL; yyerrok; ;
     break;}
 case 11:
-{ yyval.stmt = new FuncDecl(*yyvsp[-5].ident, *yyvsp[-4].ident, *yyvsp[-2].varvec, *yyvsp[0].block); delete yyvsp[-2].varvec; ;
+{ yyval.block = yyvsp[-1].block; ;
     break;}
 case 12:
-{ yyval.varvec = new VariableList(); ;
+{ yyval.block = at(new Block(), yylsp[-1]); ;
     break;}
 case 13:
-{ yyval.varvec = new VariableList(); yyval.varvec->push_back(yyvsp[0].var_decl); ;
+{ yyval.block = at(new Block(), yylsp[-2]); yyerrok; ;
     break;}
 case 14:
-{ yyvsp[-2].varvec->push_back(yyvsp[0].var_decl); ;
+{ yyval.stmt = at(new VarDecl(*yyvsp[-1].ident, *yyvsp[0].ident), yylsp[-1]); ;
     break;}
 case 15:
-{ yyval.ident = new Identifier(*yyvsp[0].string); delete yyvsp[0].string; ;
+{ yyval.stmt = at(new VarDecl(*yyvsp[-3].ident, *yyvsp[-2].ident, yyvsp[0].expr), yylsp[-3]); ;
     break;}
 case 16:
-{ yyval.expr = new ConstInt(atol(yyvsp[0].string->c_str())); delete yyvsp[0].string; ;
+{ yyval.stmt = at(new FuncDecl(*yyvsp[-5].ident, *yyvsp[-4].ident, *yyvsp[-2].varvec, *yyvsp[0].block), yylsp[-5]); delete yyvsp[-2].varvec; ;
     break;}
 case 17:
-{ yyval.expr = new ConstDouble(atof(yyvsp[0].string->c_str())); delete yyvsp[0].string; ;
+{ yyval.stmt = at(new FuncDecl(*yyvsp[-9].ident, *yyvsp[-8].ident, *yyvsp[-6].varvec, *yyvsp[0].block, yyvsp[-2].ident->name), yylsp[-9]); delete yyvsp[-6].varvec; ;
     break;}
 case 18:
-{ yyval.expr = new AssignmentExpr(*yyvsp[-2].ident, *yyvsp[0].expr); ;
+{ yyval.varvec = new VariableList(); ;
     break;}
 case 19:
-{ yyval.expr = new MethodCall(*yyvsp[-3].ident, *yyvsp[-1].exprvec); delete yyvsp[-1].exprvec; ;
+{ yyval.varvec = new VariableList(); yyval.varvec->push_back(yyvsp[0].var_decl); ;
     break;}
 case 20:
-{ yyval.ident = yyvsp[0].ident; ;
+{ yyvsp[-2].varvec->push_back(yyvsp[0].var_decl); ;
+    break;}
+case 21:
+{ yyval.ident = at(new Identifier(*yyvsp[0].string), yylsp[0]); delete yyvsp[0].string; ;
     break;}
 case 22:
-{ yyval.expr = new BinaryOp(*yyvsp[-2].expr, yyvsp[-1].token, *yyvsp[0].expr); ;
+{ yyval.expr = at(new ConstInt(atol(yyvsp[0].string->c_str())), yylsp[0]); delete yyvsp[0].string; ;
     break;}
 case 23:
-{ yyval.expr = yyvsp[-1].expr; ;
+{ yyval.expr = at(new ConstDouble(atof(yyvsp[0].string->c_str())), yylsp[0]); delete yyvsp[0].string; ;
     break;}
 case 24:
-{ yyval.exprvec = new ExpressionList(); ;
+{ yyval.expr = at(new AssignmentExpr(*yyvsp[-2].ident, *yyvsp[0].expr), yylsp[-2]); ;
     break;}
 case 25:
-{ yyval.exprvec = new ExpressionList(); yyval.exprvec->push_back(yyvsp[0].expr); ;
+{ yyval.expr = at(new MethodCall(*yyvsp[-3].ident, *yyvsp[-1].exprvec), yylsp[-3]); delete yyvsp[-1].exprvec; ;
     break;}
 case 26:
+{ yyval.ident = yyvsp[0].ident; ;
+    break;}
+case 28:
+{ yyval.expr = at(new BinaryOp(*yyvsp[-2].expr, yyvsp[-1].token, *yyvsp[0].expr), yylsp[-2]); ;
+    break;}
+case 29:
+{ yyval.expr = yyvsp[-1].expr; ;
+    break;}
+case 30:
+{ yyval.exprvec = new ExpressionList(); ;
+    break;}
+case 31:
+{ yyval.exprvec = new ExpressionList(); yyval.exprvec->push_back(yyvsp[0].expr); ;
+    break;}
+case 32:
 { yyvsp[-2].exprvec->push_back(yyvsp[0].expr); ;
     break;}
-case 37:
-{ yyval.if_expr = new IfExpr(yyvsp[-2].expr, yyvsp[0].block); ;
+case 43:
+{ yyval.stmt = at(new ReturnStmt(yyvsp[-1].expr), yylsp[-2]); ;
+    break;}
+case 44:
+{ yyval.stmt = at(new ReturnStmt(NULL), yylsp[-1]); ;
+    break;}
+case 45:
+{ yyval.if_expr = at(new IfExpr(yyvsp[-2].expr, yyvsp[0].block), yylsp[-4]); ;
+    break;}
+case 46:
+{ yyval.stmt = at(new ParallelFor(*yyvsp[-6].ident, yyvsp[-4].expr, yyvsp[-2].expr, NULL, yyvsp[0].block), yylsp[-9]); ;
+    break;}
+case 47:
+{ yyval.stmt = at(new ParallelFor(*yyvsp[-8].ident, yyvsp[-6].expr, yyvsp[-4].expr, yyvsp[-2].expr, yyvsp[0].block), yylsp[-11]); ;
     break;}
 }
    /* the action file gets copied in in place of this dollarsign */
@@ -0,0 +1,225 @@
+#include "perfmap.h"
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/ExecutionEngine/ObjectImage.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Config/config.h>
+#if defined(LLVM_VERSION_MAJOR) && LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR > 2 
+#include <llvm/IR/Function.h>
+#else
+#include <llvm/Function.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/* jitdump format, see tools/perf/Documentation/jitdump-specification.txt */
+static const uint32_t JITDUMP_MAGIC = 0x4A695444;   /* "JiTD" */
+static const uint32_t JITDUMP_VERSION = 1;
+static const uint32_t JIT_CODE_LOAD = 0;
+
+struct JitDumpHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t totalSize;
+    uint32_t elfMach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+struct JitCodeLoad
+{
+    uint32_t id;
+    uint32_t totalSize;
+    uint64_t timestamp;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t codeAddr;
+    uint64_t codeSize;
+    uint64_t codeIndex;
+    /* followed by the NUL terminated name and the code */
+};
+
+static FILE *s_pMapFile = NULL;
+static FILE *s_pDumpFile = NULL;
+static uint64_t s_CodeIndex = 0;
+static std::mutex s_Mutex;
+
+/* perf's clock when recording with -k mono */
+static uint64_t timestampNS()
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+#endif
+}
+
+static uint32_t threadId()
+{
+#ifdef _WIN32
+    return GetCurrentThreadId();
+#elif defined(SYS_gettid)
+    return (uint32_t)syscall(SYS_gettid);
+#else
+    return (uint32_t)getpid();
+#endif
+}
+
+static uint32_t elfMachine()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return 62;      /* EM_X86_64 */
+#elif defined(__aarch64__)
+    return 183;     /* EM_AARCH64 */
+#else
+    return 3;       /* EM_386 */
+#endif
+}
+
+static bool openJitDump()
+{
+    char path[64];
+    sprintf(path, "/tmp/jit-%d.dump", (int)getpid());
+    s_pDumpFile = fopen(path, "w+b");
+    if (s_pDumpFile == NULL)
+        return false;
+
+#ifndef _WIN32
+    /* perf finds the file through this executable mapping in its record */
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (mmap(NULL, pageSize, PROT_READ | PROT_EXEC, MAP_PRIVATE, fileno(s_pDumpFile), 0) == MAP_FAILED)
+    {
+        fclose(s_pDumpFile);
+        s_pDumpFile = NULL;
+        return false;
+    }
+#endif
+
+    JitDumpHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = JITDUMP_MAGIC;
+    header.version = JITDUMP_VERSION;
+    header.totalSize = sizeof(header);
+    header.elfMach = elfMachine();
+    header.pid = (uint32_t)getpid();
+    header.timestamp = timestampNS();
+    fwrite(&header, sizeof(header), 1, s_pDumpFile);
+    fflush(s_pDumpFile);
+    return true;
+}
+
+/* Either output is enough for perf, so a failed one does not stop the other */
+bool enablePerfMap(unsigned int outputs)
+{
+    std::lock_guard<std::mutex> lock(s_Mutex);
+    if ((outputs & PERF_MAP) != 0 && s_pMapFile == NULL)
+    {
+        char path[64];
+        sprintf(path, "/tmp/perf-%d.map", (int)getpid());
+        s_pMapFile = fopen(path, "w");
+    }
+    if ((outputs & PERF_JITDUMP) != 0 && s_pDumpFile == NULL)
+        openJitDump();
+    return ((outputs & PERF_MAP) != 0 && s_pMapFile != NULL) ||
+           ((outputs & PERF_JITDUMP) != 0 && s_pDumpFile != NULL);
+}
+
+bool perfMapEnabled()
+{
+    std::lock_guard<std::mutex> lock(s_Mutex);
+    return s_pMapFile != NULL || s_pDumpFile != NULL;
+}
+
+static void writeFunction(const std::string& name, const void *pCode, uint64_t size)
+{
+    std::lock_guard<std::mutex> lock(s_Mutex);
+    if (s_pMapFile != NULL)
+    {
+        fprintf(s_pMapFile, "%llx %llx %s\n", (unsigned long long)(uintptr_t)pCode, (unsigned long long)size, name.c_str());
+        fflush(s_pMapFile);    /* perf may read the map while we still run */
+    }
+
+    if (s_pDumpFile != NULL)
+    {
+        JitCodeLoad record;
+        record.id = JIT_CODE_LOAD;
+        record.totalSize = (uint32_t)(sizeof(record) + name.size() + 1 + size);
+        record.timestamp = timestampNS();
+        record.pid = (uint32_t)getpid();
+        record.tid = threadId();
+        record.vma = (uint64_t)(uintptr_t)pCode;
+        record.codeAddr = record.vma;
+        record.codeSize = size;
+        record.codeIndex = s_CodeIndex++;
+        fwrite(&record, sizeof(record), 1, s_pDumpFile);
+        fwrite(name.c_str(), name.size() + 1, 1, s_pDumpFile);
+        fwrite(pCode, (size_t)size, 1, s_pDumpFile);
+        fflush(s_pDumpFile);
+    }
+}
+
+class PerfJITListener : public llvm::JITEventListener
+{
+public:
+    /* the JIT reports each function as it is compiled */
+    virtual void NotifyFunctionEmitted(const llvm::Function& F, void *Code, size_t Size,
+                                       const EmittedFunctionDetails& Details)
+    {
+        writeFunction(F.getName(), Code, Size);
+    }
+
+    /* MCJIT only reports whole objects; their function symbols have the
+       addresses the code was loaded at */
+    virtual void NotifyObjectEmitted(const llvm::ObjectImage& Obj)
+    {
+        llvm::error_code ec;
+        for (llvm::object::symbol_iterator it = Obj.begin_symbols(), end = Obj.end_symbols(); it != end; it.increment(ec))
+        {
+            if (ec)
+                break;
+            llvm::object::SymbolRef::Type type;
+            llvm::StringRef name;
+            uint64_t address, size;
+            if (it->getType(type) || type != llvm::object::SymbolRef::ST_Function)
+                continue;
+            if (it->getName(name) || it->getAddress(address) || it->getSize(size) || size == 0)
+                continue;
+            writeFunction(name, (const void *)(uintptr_t)address, size);
+        }
+    }
+};
+
+llvm::JITEventListener* perfJITListener()
+{
+    static PerfJITListener listener;
+    return &listener;
+}
@@ -0,0 +1,288 @@
+#include "profile.h"
+#include "codegen.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#if defined(LLVM_VERSION_MAJOR) && LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR > 2 
+#include <llvm/IR/MDBuilder.h>
+#else
+#include <llvm/MDBuilder.h>
+#endif
+
+using namespace std;
+
+/* Functions called at least this often relative to the hottest one get an
+   inline hint; functions that were never called are marked cold */
+static const uint64_t HOT_FRACTION = 8;
+
+/* Profile files are plain text, one count per line:
+     function <name> <calls>
+     branch <function> <index> <taken> <not taken>
+     call <function> <index> <callee> <calls>
+   where functions are named <module>:<name>, see functionName. Names are
+   written with '%', whitespace and control characters as %XX, so that a
+   module path with spaces stays one field. */
+static std::string escapeName(const std::string& name)
+{
+    std::string escaped;
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        unsigned char c = (unsigned char)name[i];
+        if (c <= ' ' || c == '%' || c == 0x7f)
+        {
+            char hex[4];
+            sprintf(hex, "%%%02X", c);
+            escaped += hex;
+        }
+        else
+        {
+            escaped += (char)c;
+        }
+    }
+    return escaped;
+}
+
+static std::string unescapeName(const std::string& escaped)
+{
+    std::string name;
+    for (size_t i = 0; i < escaped.size(); i++)
+    {
+        if (escaped[i] == '%' && i + 2 < escaped.size() && isxdigit((unsigned char)escaped[i + 1]) && isxdigit((unsigned char)escaped[i + 2]))
+        {
+            name += (char)strtol(escaped.substr(i + 1, 2).c_str(), NULL, 16);
+            i += 2;
+        }
+        else
+        {
+            name += escaped[i];
+        }
+    }
+    return name;
+}
+
+bool Profile::read(const char *path)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string kind, function;
+        unsigned int index;
+        fields >> kind >> function;
+        function = unescapeName(function);
+
+        if (kind == "function")
+        {
+            uint64_t count;
+            if (fields >> count)
+                entries[function] += count;
+        }
+        else if (kind == "branch")
+        {
+            uint64_t taken, notTaken;
+            if (fields >> index >> taken >> notTaken)
+            {
+                std::pair<uint64_t, uint64_t>& counts = branches[Site(function, index)];
+                counts.first += taken;
+                counts.second += notTaken;
+            }
+        }
+        else if (kind == "call")
+        {
+            std::string callee;
+            uint64_t count;
+            if (fields >> index >> callee >> count)
+            {
+                std::pair<std::string, uint64_t>& counts = calls[Site(function, index)];
+                counts.first = unescapeName(callee);
+                counts.second += count;
+            }
+        }
+    }
+    return true;
+}
+
+bool Profile::write(const char *path) const
+{
+    std::ofstream out(path);
+    if (!out)
+        return false;
+
+    for (std::map<std::string, uint64_t>::const_iterator it = entries.begin(); it != entries.end(); it++)
+        out << "function " << escapeName(it->first) << " " << it->second << "\n";
+    for (std::map<Site, std::pair<uint64_t, uint64_t> >::const_iterator it = branches.begin(); it != branches.end(); it++)
+        out << "branch " << escapeName(it->first.first) << " " << it->first.second << " " << it->second.first << " " << it->second.second << "\n";
+    for (std::map<Site, std::pair<std::string, uint64_t> >::const_iterator it = calls.begin(); it != calls.end(); it++)
+        out << "call " << escapeName(it->first.first) << " " << it->first.second << " " << escapeName(it->second.first) << " " << it->second.second << "\n";
+    return out.good();
+}
+
+/* The same file, however it was named on the command line */
+static std::string canonicalPath(const std::string& path)
+{
+#ifdef _WIN32
+    char full[_MAX_PATH];
+    if (_fullpath(full, path.c_str(), _MAX_PATH) == NULL)
+        return path;
+    return full;
+#else
+    char *pFull = realpath(path.c_str(), NULL);
+    if (pFull == NULL)
+        return path;    /* not a file, such as the library's module names */
+    std::string full(pFull);
+    free(pFull);
+    return full;
+#endif
+}
+
+/* Files compiled in one run may define functions of the same name, so the
+   module identifier, the source path for the driver, is part of the name */
+std::string ProfileBuilder::functionName(llvm::Function *function)
+{
+    const std::string& module = function->getParent()->getModuleIdentifier();
+    std::map<std::string, std::string>::iterator it = modules.find(module);
+    if (it == modules.end())
+        it = modules.insert(std::make_pair(module, canonicalPath(module))).first;
+    return it->second + ":" + function->getName().str();
+}
+
+/* Branches and calls are numbered in the order they are generated */
+Profile::Site ProfileBuilder::nextSite(llvm::Function *function)
+{
+    std::string name = functionName(function);
+    return Profile::Site(name, sites[name]++);
+}
+
+/* Increment a new 64 bit counter, before an instruction or at the end of a block */
+void ProfileBuilder::addCounter(llvm::BasicBlock *block, llvm::Instruction *before, char kind, 
+                                const Profile::Site& site, const std::string& callee)
+{
+    llvm::Module *module = block->getParent()->getParent();
+    llvm::Type *pType = llvm::Type::getInt64Ty(module->getContext());
+    Counter counter;
+    counter.kind = kind;
+    counter.site = site;
+    counter.callee = callee;
+    counter.var = new llvm::GlobalVariable(*module, pType, false, llvm::GlobalValue::InternalLinkage,
+                                           llvm::Constant::getNullValue(pType), "__minic_prof");
+    counters.push_back(counter);
+
+    llvm::IRBuilder<> builder(block);
+    if (before != NULL)
+        builder.SetInsertPoint(before);
+    builder.CreateStore(builder.CreateAdd(builder.CreateLoad(counter.var), builder.getInt64(1)), counter.var);
+}
+
+void ProfileBuilder::functionEntry(llvm::Function *function)
+{
+    if (instrument)
+        addCounter(&function->getEntryBlock(), NULL, 'f', Profile::Site(functionName(function), 0), "");
+}
+
+/* The taken side is counted at the start of the first successor, which
+   must still be empty; not taken is derived from the executions */
+void ProfileBuilder::branch(llvm::BranchInst *branch)
+{
+    Profile::Site site = nextSite(branch->getParent()->getParent());
+    if (instrument)
+    {
+        addCounter(branch->getParent(), branch, 'b', site, "");
+        addCounter(branch->getSuccessor(0), NULL, 't', site, "");
+        return;
+    }
+
+    std::map<Profile::Site, std::pair<uint64_t, uint64_t> >::iterator it = profile.branches.find(site);
+    if (it == profile.branches.end())
+        return;
+
+    /* Weights are 32 bit; keep the ratio and never let a side drop to zero */
+    uint64_t taken = it->second.first, notTaken = it->second.second;
+    uint64_t scale = (std::max(taken, notTaken) >> 31) + 1;
+    llvm::MDBuilder md(branch->getContext());
+    branch->setMetadata(llvm::LLVMContext::MD_prof, md.createBranchWeights((uint32_t)(taken / scale) + 1, 
+                                                                           (uint32_t)(notTaken / scale) + 1));
+}
+
+void ProfileBuilder::call(llvm::CallInst *call)
+{
+    Profile::Site site = nextSite(call->getParent()->getParent());
+    llvm::Function *callee = call->getCalledFunction();
+    if (instrument)
+    {
+        addCounter(call->getParent(), call, 'c', site, callee->getName());
+        return;
+    }
+
+    /* Keep call sites that never ran out of the inliner's way */
+    std::map<Profile::Site, std::pair<std::string, uint64_t> >::iterator it = profile.calls.find(site);
+    if (it != profile.calls.end() && it->second.first == callee->getName() && it->second.second == 0)
+        call->addAttribute(llvm::AttributeSet::FunctionIndex, llvm::Attribute::NoInline);
+}
+
+/* Function entry counts have no IR representation yet, so they are mapped
+   to the cold and inlinehint attributes */
+void ProfileBuilder::annotate(llvm::Module *module)
+{
+    if (instrument || profile.entries.empty())
+        return;
+
+    uint64_t hottest = 0;
+    for (std::map<std::string, uint64_t>::iterator it = profile.entries.begin(); it != profile.entries.end(); it++)
+        hottest = std::max(hottest, it->second);
+
+    for (llvm::Module::iterator f = module->begin(); f != module->end(); f++)
+    {
+        std::map<std::string, uint64_t>::iterator it = profile.entries.find(functionName(f));
+        if (f->isDeclaration() || it == profile.entries.end())
+            continue;
+
+        if (it->second == 0)
+        {
+            f->addFnAttr(llvm::Attribute::Cold);
+            f->addFnAttr(llvm::Attribute::OptimizeForSize);
+        }
+        else if (it->second * HOT_FRACTION >= hottest && hottest > 1)
+        {
+            f->addFnAttr(llvm::Attribute::InlineHint);
+        }
+    }
+}
+
+/* Read the counters of the finished run into the profile */
+void ProfileBuilder::collect(llvm::ExecutionEngine *engine)
+{
+    if (!instrument)
+        return;
+
+    for (std::vector<Counter>::iterator it = counters.begin(); it != counters.end(); it++)
+    {
+        uint64_t count = *(uint64_t*)engine->getPointerToGlobal(it->var);
+        switch (it->kind)
+        {
+            case 'f':
+                profile.entries[it->site.first] += count;
+                break;
+            case 'b':
+                profile.branches[it->site].second += count;   /* executions until 't' is subtracted */
+                break;
+            case 't':
+                profile.branches[it->site].first += count;
+                profile.branches[it->site].second -= count;
+                break;
+            case 'c':
+                profile.calls[it->site].first = it->callee;
+                profile.calls[it->site].second += count;
+                break;
+        }
+    }
+}
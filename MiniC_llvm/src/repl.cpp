@@ -0,0 +1,117 @@
+#include "repl.h"
+#include "node.h"
+#include "frontend.h"
+
+#include <sstream>
+
+using namespace std;
+
+ReplSession::ReplSession() : snippetCount(0)
+{
+    llvm::InitializeNativeTarget();
+
+    std::string err;
+    context.interactive = true;
+    context.engine = llvm::EngineBuilder(context.module)
+                         .setEngineKind(llvm::EngineKind::JIT)
+                         .setErrorStr(&err)
+                         .create();
+    if (context.engine == NULL)
+    {
+        std::cerr << "Could not create JIT: " << err << endl;
+    }
+}
+
+ReplSession::~ReplSession()
+{
+    /* the engine owns every module that was added to it */
+    delete context.engine;
+}
+
+/* Parse, compile and run one snippet. Returns false if it was rejected. */
+bool ReplSession::eval(const std::string& source, std::ostream& out)
+{
+    if (context.engine == NULL)
+        return false;
+
+    Block *root = parseString(source);
+    if (root == NULL)
+        return false;
+
+    std::ostringstream name;
+    name << "__repl" << snippetCount++;
+
+    context.newModule(name.str());
+    context.engine->addModule(context.module);
+    unsigned int errorsBefore = context.errorCount;
+    llvm::Function *function = context.generateSnippet(*root, name.str());
+
+    /* A snippet that did not compile must not poison the session */
+    if (context.errorCount != errorsBefore || llvm::verifyModule(*context.module, llvm::ReturnStatusAction))
+    {
+        std::cerr << "error: snippet rejected" << endl;
+        context.engine->removeModule(context.module);
+        delete context.module;
+        context.module = NULL;
+        return false;
+    }
+    context.publishModule();
+
+    void *pCode = context.engine->getPointerToFunction(function);
+    llvm::Type *pRetType = function->getReturnType();
+    if (pRetType->isIntegerTy(32))
+    {
+        out << ((int (*)())pCode)() << endl;
+    }
+    else if (pRetType->isDoubleTy())
+    {
+        out << ((double (*)())pCode)() << endl;
+    }
+    else
+    {
+        ((void (*)())pCode)();
+    }
+
+    return true;
+}
+
+/* Read snippets until EOF or ":quit". A snippet ends at the first line
+   break where all braces are closed. */
+int ReplSession::run(std::istream& in, std::ostream& out)
+{
+    std::string line, source;
+    int depth = 0;
+
+    out << "> " << flush;
+    while (std::getline(in, line))
+    {
+        if (source.empty() && (line == ":quit" || line == ":q"))
+            break;
+
+        for (std::string::const_iterator it = line.begin(); it != line.end(); it++)
+        {
+            if (*it == '{')
+                depth++;
+            else if (*it == '}')
+                depth--;
+        }
+
+        source += line;
+        source += '\n';
+
+        if (depth <= 0)
+        {
+            if (source.find_first_not_of(" \t\n") != std::string::npos)
+                eval(source, out);
+            source.clear();
+            depth = 0;
+            out << "> " << flush;
+        }
+        else
+        {
+            out << ". " << flush;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,202 @@
+#include "runtime.h"
+#include "counters.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <llvm/Support/DynamicLibrary.h>
+
+#ifdef _MSC_VER
+#define RUNTIME_THREAD_LOCAL __declspec(thread)
+#else
+#define RUNTIME_THREAD_LOCAL __thread
+#endif
+
+using namespace std;
+
+/* Chunks per thread when the grain is left to the runtime */
+static const int CHUNKS_PER_THREAD = 8;
+
+namespace
+{
+    struct Job
+    {
+        ParallelBody body;
+        void **ctx;
+        std::atomic<int> pending;   /* chunks not finished yet */
+    };
+
+    struct Chunk
+    {
+        Job *job;
+        int lo, hi;
+    };
+
+    /* Owners push and pop at the back, thieves take from the front where
+       the oldest and usually largest amount of work sits */
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Chunk> chunks;
+    };
+
+    class WorkerPool
+    {
+        std::vector<WorkQueue*> queues;     /* queue 0 belongs to threads outside the pool */
+        std::mutex sleepMutex;
+        std::condition_variable wakeup;
+        std::atomic<int> queued;
+
+        void workerLoop(unsigned int self);
+
+    public:
+        WorkerPool(unsigned int threads);
+
+        unsigned int size() const { return (unsigned int)queues.size(); }
+        void push(unsigned int queue, const Chunk& chunk);
+        void wakeAll();
+        bool runOne(unsigned int self);
+    };
+}
+
+/* Index of the pool queue the current thread owns */
+static RUNTIME_THREAD_LOCAL unsigned int t_Queue = 0;
+
+WorkerPool::WorkerPool(unsigned int threads) : queued(0)
+{
+    for (unsigned int i = 0; i < threads; i++)
+        queues.push_back(new WorkQueue());
+
+    /* Workers are never joined; they sleep until the process exits */
+    for (unsigned int i = 1; i < threads; i++)
+        std::thread(&WorkerPool::workerLoop, this, i).detach();
+}
+
+void WorkerPool::push(unsigned int queue, const Chunk& chunk)
+{
+    {
+        std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+        queues[queue]->chunks.push_back(chunk);
+    }
+    queued++;
+}
+
+void WorkerPool::wakeAll()
+{
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    wakeup.notify_all();
+}
+
+/* Runs one chunk from our own queue, or stolen from another one */
+bool WorkerPool::runOne(unsigned int self)
+{
+    Chunk chunk;
+    bool found = false;
+    for (unsigned int i = 0; i < queues.size() && !found; i++)
+    {
+        WorkQueue *queue = queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (queue->chunks.empty())
+            continue;
+        if (i == 0)
+        {
+            chunk = queue->chunks.back();
+            queue->chunks.pop_back();
+        }
+        else
+        {
+            chunk = queue->chunks.front();
+            queue->chunks.pop_front();
+        }
+        found = true;
+    }
+
+    if (!found)
+        return false;
+
+    queued--;
+    chunk.job->body(chunk.job->ctx, chunk.lo, chunk.hi);
+    chunk.job->pending--;
+    return true;
+}
+
+void WorkerPool::workerLoop(unsigned int self)
+{
+    t_Queue = self;
+    for (;;)
+    {
+        if (runOne(self))
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        while (queued.load() == 0)
+            wakeup.wait(lock);
+    }
+}
+
+static WorkerPool* workerPool()
+{
+    static std::mutex s_Mutex;
+    static WorkerPool *s_pPool = NULL;
+
+    std::lock_guard<std::mutex> lock(s_Mutex);
+    if (s_pPool == NULL)
+    {
+        const char *env = getenv("MINIC_THREADS");
+        int threads = env != NULL ? atoi(env) : (int)std::thread::hardware_concurrency();
+        s_pPool = new WorkerPool(threads > 0 ? threads : 1);
+    }
+    return s_pPool;
+}
+
+extern "C" void minic_parallel_for(ParallelBody body, void **ctx, int lo, int hi, int grain)
+{
+    if (hi <= lo)
+        return;
+
+    WorkerPool *pool = workerPool();
+    if (grain <= 0)
+        grain = std::max(1, (hi - lo) / (int)(pool->size() * CHUNKS_PER_THREAD));
+
+    /* Small loops are not worth waking anybody up for */
+    if (hi - lo <= grain || pool->size() == 1)
+    {
+        body(ctx, lo, hi);
+        return;
+    }
+
+    Job job;
+    job.body = body;
+    job.ctx = ctx;
+    job.pending = (hi - lo + grain - 1) / grain;
+
+    /* Deal the chunks out round robin so every worker starts on its own queue */
+    unsigned int queue = t_Queue;
+    for (int start = lo; start < hi; start += grain)
+    {
+        Chunk chunk = { &job, start, std::min(hi, start + grain) };
+        pool->push(queue, chunk);
+        queue = (queue + 1) % pool->size();
+    }
+    pool->wakeAll();
+
+    /* Help out until our own chunks are done, which may include chunks of
+       other loops */
+    while (job.pending.load() > 0)
+    {
+        if (!pool->runOne(t_Queue))
+            std::this_thread::yield();
+    }
+}
+
+void registerRuntime()
+{
+    llvm::sys::DynamicLibrary::AddSymbol("minic_parallel_for", (void *)&minic_parallel_for);
+    llvm::sys::DynamicLibrary::AddSymbol("minic_counter_table", (void *)&minic_counter_table);
+}
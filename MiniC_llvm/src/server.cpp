@@ -0,0 +1,261 @@
+#include "server.h"
+#include "node.h"
+#include "frontend.h"
+#include "emit.h"
+#include "nullstream.h"
+#include "diagnostics.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+/* Compiled outputs kept per source text before the cache is flushed */
+static const size_t CACHE_LIMIT = 256;
+
+/* FNV-1a over the request kind and the source text */
+static size_t hashSource(unsigned int kind, const char *source, size_t length)
+{
+    size_t hash = (size_t)2166136261u ^ kind;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)source[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+CompileServer::CompileServer() : machine(NULL), engine(NULL)
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    std::string err;
+    machine = createHostTargetMachine(err);
+    if (machine == NULL)
+    {
+        std::cerr << "No target machine: " << err << endl;
+    }
+
+    /* The engine outlives every request; each run adds and removes its module */
+    engine = llvm::EngineBuilder(new llvm::Module("server", llvm::getGlobalContext()))
+                 .setEngineKind(llvm::EngineKind::JIT)
+                 .setErrorStr(&err)
+                 .create();
+    if (engine == NULL)
+    {
+        std::cerr << "Could not create JIT: " << err << endl;
+    }
+}
+
+CompileServer::~CompileServer()
+{
+    delete engine;
+    delete machine;
+}
+
+/* Syntax and semantic errors go back to the client, and the request's
+   tree is released with the arena when the request is done */
+bool CompileServer::compile(unsigned int kind, char *source, size_t length, std::string& out)
+{
+    NodeArena nodes;
+    NodeArena::Use use(nodes);
+    Diagnostics diagnostics;
+    Block *root = parseBuffer(source, length, diagnostics);
+    if (root == NULL)
+    {
+        out = diagnostics.str();
+        return false;
+    }
+
+    NullStream quiet;
+    DiagnosticStream semantic(diagnostics);
+    CodeGenContext context;
+    context.logStream = &quiet;
+    context.diagnostics = &semantic;
+    context.dumpIR = false;
+    context.generateSnippet(*root, "minic_main");
+    if (diagnostics.hasErrors() || llvm::verifyModule(*context.module, llvm::ReturnStatusAction))
+    {
+        out = diagnostics.hasErrors() ? diagnostics.str() : "invalid module";
+        delete context.module;
+        return false;
+    }
+    context.optimize();
+
+    std::string err;
+    bool ok = true;
+    if (kind == REQUEST_BITCODE)
+    {
+        emitBitcode(*context.module, out);
+    }
+    else if (machine == NULL || !emitObject(*context.module, *machine, out, err))
+    {
+        out = machine == NULL ? "no target machine" : err;
+        ok = false;
+    }
+
+    delete context.module;
+    return ok;
+}
+
+bool CompileServer::execute(char *source, size_t length, std::string& out)
+{
+    NodeArena nodes;
+    NodeArena::Use use(nodes);
+    Diagnostics diagnostics;
+    Block *root = parseBuffer(source, length, diagnostics);
+    if (root == NULL || engine == NULL)
+    {
+        out = root == NULL ? diagnostics.str() : "no JIT";
+        return false;
+    }
+
+    NullStream quiet;
+    DiagnosticStream semantic(diagnostics);
+    CodeGenContext context;
+    context.logStream = &quiet;
+    context.diagnostics = &semantic;
+    context.dumpIR = false;
+    context.engine = engine;
+    engine->addModule(context.module);
+
+    llvm::Function *function = context.generateSnippet(*root, "minic_main");
+    bool ok = !diagnostics.hasErrors() && !llvm::verifyModule(*context.module, llvm::ReturnStatusAction);
+    if (ok)
+    {
+        context.optimize();
+
+        std::ostringstream result;
+        void *pCode = engine->getPointerToFunction(function);
+        llvm::Type *pRetType = function->getReturnType();
+        if (pRetType->isIntegerTy(32))
+            result << ((int (*)())pCode)();
+        else if (pRetType->isDoubleTy())
+            result << ((double (*)())pCode)();
+        else
+            ((void (*)())pCode)();
+        out = result.str();
+    }
+    else
+    {
+        out = diagnostics.hasErrors() ? diagnostics.str() : "invalid module";
+    }
+
+    /* Drop the request's code but keep the engine warm for the next one */
+    for (llvm::Module::iterator it = context.module->begin(); it != context.module->end(); it++)
+    {
+        if (!it->isDeclaration())
+            engine->freeMachineCodeForFunction(it);
+    }
+    engine->removeModule(context.module);
+    delete context.module;
+    return ok;
+}
+
+bool CompileServer::handle(unsigned int kind, char *source, size_t length, std::string& out)
+{
+    if (kind == REQUEST_RUN)
+        return execute(source, length, out);
+
+    if (kind != REQUEST_BITCODE && kind != REQUEST_OBJECT)
+    {
+        out = "unknown request";
+        return false;
+    }
+
+    size_t hash = hashSource(kind, source, length);
+    typedef std::multimap<size_t, CacheEntry>::iterator CacheIterator;
+    std::pair<CacheIterator, CacheIterator> range = cache.equal_range(hash);
+    for (CacheIterator it = range.first; it != range.second; it++)
+    {
+        const CacheEntry& entry = it->second;
+        if (entry.kind == kind && entry.source.size() == length && 
+            (length == 0 || memcmp(entry.source.data(), source, length) == 0))
+        {
+            out = entry.output;
+            return true;
+        }
+    }
+
+    if (!compile(kind, source, length, out))
+        return false;
+
+    if (cache.size() >= CACHE_LIMIT)
+        cache.clear();
+    CacheEntry entry;
+    entry.kind = kind;
+    entry.source.assign(source, length);
+    entry.output = out;
+    cache.insert(std::make_pair(hash, entry));
+    return true;
+}
+
+/* Serve requests on a Unix domain socket until the process is killed */
+int CompileServer::run(const std::string& path)
+{
+    initSockets();
+
+    struct sockaddr_un addr;
+    if (!fillAddress(path, addr))
+    {
+        std::cerr << "Socket path too long: " << path << endl;
+        return -1;
+    }
+
+    socket_t listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == INVALID_SOCKET)
+    {
+        std::cerr << "Could not create socket" << endl;
+        return -1;
+    }
+
+    remove(path.c_str());
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 16) != 0)
+    {
+        std::cerr << "Could not listen on " << path << endl;
+        closeSocket(listener);
+        return -1;
+    }
+
+    std::cout << "Listening on " << path << endl;
+    for (;;)
+    {
+        socket_t client = accept(listener, NULL, NULL);
+        if (client == INVALID_SOCKET)
+            continue;
+
+        /* Sources are received into one buffer and parsed where they lie */
+        std::vector<char> source;
+        RequestHeader request;
+        while (recvAll(client, &request, sizeof(request)) && request.magic == PROTOCOL_MAGIC)
+        {
+            /* The body of an oversized request is never read, so the connection cannot continue */
+            if (request.length > MAX_REQUEST_LENGTH)
+            {
+                static const char message[] = "request too large";
+                ResponseHeader response;
+                response.status = RESPONSE_ERROR;
+                response.length = sizeof(message) - 1;
+                if (sendAll(client, &response, sizeof(response)))
+                    sendAll(client, message, response.length);
+                break;
+            }
+
+            source.assign(request.length + SCAN_PADDING, '\0');
+            if (request.length > 0 && !recvAll(client, &source[0], request.length))
+                break;
+
+            std::string out;
+            ResponseHeader response;
+            response.status = handle(request.kind, &source[0], request.length, out) ? RESPONSE_OK : RESPONSE_ERROR;
+            response.length = (unsigned int)out.size();
+            if (!sendAll(client, &response, sizeof(response)) || !sendAll(client, out.data(), out.size()))
+                break;
+        }
+
+        closeSocket(client);
+    }
+}
@@ -0,0 +1,13 @@
+#include "source.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void SourceMap::resolve(SourceOffset offset, unsigned int& line, unsigned int& column) const
+{
+    /* the last line starting at or before the offset */
+    vector<SourceOffset>::const_iterator it = upper_bound(lineStarts.begin(), lineStarts.end(), offset) - 1;
+    line = (unsigned int)(it - lineStarts.begin()) + 1;
+    column = offset - *it + 1;
+}
@@ -0,0 +1,258 @@
+#include "tiering.h"
+#include "trace.h"
+#include "perfmap.h"
+
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Support/InstIterator.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Threading.h>
+
+using namespace std;
+
+/* Called from baseline code when a function gets hot */
+extern "C" void minic_tier_promote(TieredEngine *engine, unsigned int id)
+{
+    engine->promote(id);
+}
+
+TieredEngine::TieredEngine(llvm::Module *module, unsigned int threshold)
+    : threshold(threshold), slots(NULL), counts(NULL), baseline(NULL),
+      optContext(NULL), optModule(NULL), optimized(NULL), stopping(false)
+{
+    llvm::llvm_start_multithreaded();
+
+    instrument(module);
+
+    std::string err;
+    baseline = llvm::EngineBuilder(module)
+                   .setEngineKind(llvm::EngineKind::JIT)
+                   .setOptLevel(llvm::CodeGenOpt::None)    /* selects FastISel */
+                   .setErrorStr(&err)
+                   .create();
+    if (baseline == NULL)
+    {
+        std::cerr << "Could not create JIT: " << err << endl;
+        return;
+    }
+    if (perfMapEnabled())
+        baseline->RegisterJITEventListener(perfJITListener());
+
+    baseline->addGlobalMapping(module->getNamedGlobal("__minic_tier_slots"), slots);
+    baseline->addGlobalMapping(module->getNamedGlobal("__minic_tier_counts"), counts);
+    baseline->addGlobalMapping(module->getFunction("minic_tier_promote"), (void *)&minic_tier_promote);
+
+    /* Lazy stubs: a function is only compiled once it is first called */
+    for (unsigned int id = 0; id < names.size(); id++)
+        slots[id].store(baseline->getPointerToFunctionOrStub(module->getFunction(names[id])));
+
+    for (llvm::Module::global_iterator it = module->global_begin(); it != module->global_end(); it++)
+    {
+        if (!it->isDeclaration())
+            globals[it->getName()] = baseline->getPointerToGlobal(it);
+    }
+
+    worker = std::thread(&TieredEngine::workerLoop, this);
+}
+
+TieredEngine::~TieredEngine()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_one();
+    if (worker.joinable())
+        worker.join();
+
+    delete optimized;
+    delete optContext;
+    delete baseline;
+    delete[] slots;
+    delete[] counts;
+}
+
+/* Route calls through the slot table, keep a copy for the optimizing tier,
+   then add the call counters that only the baseline tier carries */
+void TieredEngine::instrument(llvm::Module *module)
+{
+    llvm::LLVMContext& ctx = module->getContext();
+    std::map<llvm::Function*, unsigned int> ids;
+    for (llvm::Module::iterator it = module->begin(); it != module->end(); it++)
+    {
+        if (!it->isDeclaration())
+        {
+            ids[it] = (unsigned int)names.size();
+            names.push_back(it->getName());
+        }
+    }
+
+    unsigned int count = (unsigned int)names.size();
+    slots = new std::atomic<void*>[count];
+    counts = new unsigned int[count]();
+
+    llvm::Type *pCodeType = llvm::Type::getInt8PtrTy(ctx);
+    llvm::GlobalVariable *slotTable = new llvm::GlobalVariable(*module, llvm::ArrayType::get(pCodeType, count), false,
+                                                               llvm::GlobalValue::ExternalLinkage, NULL, "__minic_tier_slots");
+
+    std::vector<llvm::CallInst*> calls;
+    for (llvm::Module::iterator f = module->begin(); f != module->end(); f++)
+    {
+        for (llvm::inst_iterator it = llvm::inst_begin(f); it != llvm::inst_end(f); it++)
+        {
+            llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(&*it);
+            if (call != NULL && ids.count(call->getCalledFunction()))
+                calls.push_back(call);
+        }
+    }
+
+    llvm::IRBuilder<> builder(ctx);
+    for (std::vector<llvm::CallInst*>::iterator it = calls.begin(); it != calls.end(); it++)
+    {
+        llvm::CallInst *call = *it;
+        llvm::Function *callee = call->getCalledFunction();
+        builder.SetInsertPoint(call);
+
+        llvm::LoadInst *code = builder.CreateLoad(builder.CreateConstInBoundsGEP2_32(slotTable, 0, ids[callee]));
+        code->setAlignment(sizeof(void*));
+        code->setAtomic(llvm::Unordered);   /* the worker replaces entries while we run */
+
+        std::vector<llvm::Value*> args(call->op_begin(), call->op_begin() + call->getNumArgOperands());
+        llvm::CallInst *indirect = builder.CreateCall(builder.CreatePointerCast(code, callee->getType()), args);
+        indirect->setCallingConv(call->getCallingConv());
+        indirect->setTailCall(call->isTailCall());
+        indirect->takeName(call);
+        call->replaceAllUsesWith(indirect);
+        call->eraseFromParent();
+    }
+
+    {
+        llvm::raw_string_ostream os(bitcode);
+        llvm::WriteBitcodeToFile(module, os);
+    }
+
+    llvm::GlobalVariable *countTable = new llvm::GlobalVariable(*module, llvm::ArrayType::get(builder.getInt32Ty(), count), false,
+                                                                llvm::GlobalValue::ExternalLinkage, NULL, "__minic_tier_counts");
+    llvm::Type *promoteArgs[] = { pCodeType, builder.getInt32Ty() };
+    llvm::Function *promoteFn = llvm::Function::Create(llvm::FunctionType::get(builder.getVoidTy(), promoteArgs, false),
+                                                       llvm::GlobalValue::ExternalLinkage, "minic_tier_promote", module);
+
+    for (std::map<llvm::Function*, unsigned int>::iterator it = ids.begin(); it != ids.end(); it++)
+    {
+        llvm::Function *function = it->first;
+        llvm::BasicBlock *entry = &function->getEntryBlock();
+
+        /* allocas stay in the entry block so that they can still be promoted */
+        llvm::BasicBlock::iterator split = entry->begin();
+        while (llvm::isa<llvm::AllocaInst>(split))
+            split++;
+        llvm::BasicBlock *body = entry->splitBasicBlock(split, "body");
+        llvm::BasicBlock *hot = llvm::BasicBlock::Create(ctx, "tierup", function, body);
+        entry->getTerminator()->eraseFromParent();
+
+        builder.SetInsertPoint(entry);
+        llvm::Value *counter = builder.CreateConstInBoundsGEP2_32(countTable, 0, it->second);
+        llvm::Value *calls = builder.CreateAdd(builder.CreateLoad(counter), builder.getInt32(1));
+        builder.CreateStore(calls, counter);
+        builder.CreateCondBr(builder.CreateICmpEQ(calls, builder.getInt32(threshold)), hot, body);
+
+        builder.SetInsertPoint(hot);
+        llvm::Value *self = builder.CreateIntToPtr(builder.getIntN(sizeof(void*) * 8, (uint64_t)(uintptr_t)this), pCodeType);
+        builder.CreateCall2(promoteFn, self, builder.getInt32(it->second));
+        builder.CreateBr(body);
+    }
+}
+
+void TieredEngine::run(llvm::Function *entry)
+{
+    std::vector<llvm::GenericValue> noargs;
+    baseline->runFunction(entry, noargs);
+}
+
+/* Runs on whatever thread crossed the threshold, so only queue the work */
+void TieredEngine::promote(unsigned int id)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(id);
+    }
+    wakeup.notify_one();
+}
+
+void TieredEngine::compileOptimized(unsigned int id)
+{
+    /* The span is the only record of a tier-up; the program's own output stays clean */
+    TraceSpan span("tierup", names[id]);
+
+    if (optModule == NULL)
+    {
+        /* The optimizing tier shares nothing with the baseline's LLVMContext,
+           which keeps being used by lazy compilation on the main thread */
+        optContext = new llvm::LLVMContext();
+        std::string err;
+        llvm::MemoryBuffer *buffer = llvm::MemoryBuffer::getMemBuffer(bitcode, "tier", false);
+        optModule = llvm::ParseBitcodeFile(buffer, *optContext, &err);
+        delete buffer;
+        if (optModule == NULL)
+        {
+            std::cerr << "Tier-up failed: " << err << endl;
+            return;
+        }
+
+        optimized = llvm::EngineBuilder(optModule)
+                        .setEngineKind(llvm::EngineKind::JIT)
+                        .setOptLevel(llvm::CodeGenOpt::Aggressive)
+                        .setErrorStr(&err)
+                        .create();
+        if (optimized == NULL)
+        {
+            std::cerr << "Tier-up failed: " << err << endl;
+            return;
+        }
+        if (perfMapEnabled())
+            optimized->RegisterJITEventListener(perfJITListener());
+
+        /* Both tiers have to see the same table and the same variables */
+        optimized->addGlobalMapping(optModule->getNamedGlobal("__minic_tier_slots"), slots);
+        for (llvm::Module::global_iterator it = optModule->global_begin(); it != optModule->global_end(); it++)
+        {
+            std::map<std::string, void*>::iterator var = globals.find(it->getName());
+            if (var != globals.end())
+                optimized->addGlobalMapping(it, var->second);
+        }
+    }
+
+    if (optimized == NULL)
+        return;
+
+    llvm::Function *function = optModule->getFunction(names[id]);
+    llvm::FunctionPassManager fpm(optModule);
+    fpm.add(llvm::createBasicAliasAnalysisPass());
+    fpm.add(llvm::createPromoteMemoryToRegisterPass());
+    fpm.add(llvm::createInstructionCombiningPass());
+    fpm.add(llvm::createReassociatePass());
+    fpm.add(llvm::createGVNPass());
+    fpm.add(llvm::createCFGSimplificationPass());
+    fpm.doInitialization();
+    fpm.run(*function);
+    fpm.doFinalization();
+
+    slots[id].store(optimized->getPointerToFunction(function), std::memory_order_release);
+}
+
+void TieredEngine::workerLoop()
+{
+    for (;;)
+    {
+        unsigned int id;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (queue.empty() && !stopping)
+                wakeup.wait(lock);
+            if (stopping)
+                return;
+            id = queue.front();
+            queue.pop_front();
+        }
+        compileOptimized(id);
+    }
+}
@@ -0,0 +1,160 @@
+#include "timereport.h"
+#include "codegen.h"
+
+#include <iomanip>
+
+#ifdef _WIN32
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+void TimeReport::addPhase(const std::string& name, double seconds)
+{
+    /* phases that run more than once, e.g. per snippet, accumulate */
+    for (std::vector<Entry>::iterator it = phases.begin(); it != phases.end(); it++)
+    {
+        if (it->name == name)
+        {
+            it->value += seconds;
+            return;
+        }
+    }
+    phases.push_back(Entry(name, seconds));
+}
+
+void TimeReport::addPass(const std::string& name, double seconds)
+{
+    for (std::vector<Entry>::iterator it = passes.begin(); it != passes.end(); it++)
+    {
+        if (it->name == name)
+        {
+            it->value += seconds;
+            return;
+        }
+    }
+    passes.push_back(Entry(name, seconds));
+}
+
+void TimeReport::setCounter(const std::string& name, double value)
+{
+    for (std::vector<Entry>::iterator it = counters.begin(); it != counters.end(); it++)
+    {
+        if (it->name == name)
+        {
+            it->value = value;
+            return;
+        }
+    }
+    counters.push_back(Entry(name, value));
+}
+
+void TimeReport::print(std::ostream& out) const
+{
+    double total = 0;
+    for (std::vector<Entry>::const_iterator it = phases.begin(); it != phases.end(); it++)
+        total += it->value;
+
+    out << "===-------------------------------------------------------------------------===" << endl
+        << "                          MiniC compile time report" << endl
+        << "===-------------------------------------------------------------------------===" << endl;
+
+    out << fixed << setprecision(6);
+    for (std::vector<Entry>::const_iterator it = phases.begin(); it != phases.end(); it++)
+    {
+        out << "  " << setw(12) << it->value << " s  " 
+            << setw(5) << setprecision(1) << (total > 0 ? 100.0 * it->value / total : 0.0) << "%  "
+            << setprecision(6) << it->name << endl;
+    }
+    out << "  " << setw(12) << total << " s         total" << endl << endl;
+
+    if (!passes.empty())
+    {
+        out << "  Optimization passes:" << endl;
+        for (std::vector<Entry>::const_iterator it = passes.begin(); it != passes.end(); it++)
+            out << "  " << setw(12) << it->value << " s  " << it->name << endl;
+        out << endl;
+    }
+
+    out << setprecision(0);
+    for (std::vector<Entry>::const_iterator it = counters.begin(); it != counters.end(); it++)
+        out << "  " << setw(12) << it->value << "    " << it->name << endl;
+    out.unsetf(ios::floatfield);
+}
+
+static void printJSONEntries(std::ostream& out, const char *name, const std::vector<TimeReport::Entry>& entries)
+{
+    out << "  \"" << name << "\": {";
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        out << (i == 0 ? "" : ",") << endl << "    \"" << entries[i].name << "\": " << entries[i].value;
+    }
+    out << endl << "  }";
+}
+
+void TimeReport::printJSON(std::ostream& out) const
+{
+    out << setprecision(9) << "{" << endl;
+    printJSONEntries(out, "phases", phases);
+    out << "," << endl;
+    printJSONEntries(out, "passes", passes);
+    out << "," << endl;
+    printJSONEntries(out, "counters", counters);
+    out << endl << "}" << endl;
+}
+
+unsigned long countInstructions(const llvm::Module& module)
+{
+    unsigned long count = 0;
+    for (llvm::Module::const_iterator f = module.begin(); f != module.end(); f++)
+    {
+        for (llvm::Function::const_iterator b = f->begin(); b != f->end(); b++)
+            count += b->size();
+    }
+    return count;
+}
+
+unsigned long peakResidentKB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return (unsigned long)(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+unsigned long currentResidentKB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return (unsigned long)(counters.WorkingSetSize / 1024);
+#elif defined(__linux__)
+    unsigned long size = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL)
+        return 0;
+    if (fscanf(statm, "%lu %lu", &size, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return 0;   /* not tracked on this platform */
+#endif
+}
@@ -0,0 +1,182 @@
+#include "trace.h"
+#include "timing.h"
+
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/Config/config.h>
+#if defined(LLVM_VERSION_MAJOR) && LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR > 2 
+#include <llvm/IR/Function.h>
+#else
+#include <llvm/Function.h>
+#endif
+
+#ifdef _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+using namespace std;
+
+struct TraceEvent
+{
+    const char *category;
+    std::string name;
+    char phase;             /* 'X' complete, 'i' instant */
+    double ts;              /* microseconds since the trace was enabled */
+    double dur;
+    const char *argName;
+    double argValue;
+};
+
+struct TraceBuffer
+{
+    unsigned int tid;
+    std::vector<TraceEvent> events;
+};
+
+static bool s_bEnabled = false;
+static double s_dEpoch = 0;
+static std::mutex s_Mutex;                      /* guards s_Buffers, not the buffers themselves */
+static std::vector<TraceBuffer*> s_Buffers;
+static TRACE_THREAD_LOCAL TraceBuffer *t_pBuffer = NULL;
+
+static TraceBuffer* threadBuffer()
+{
+    if (t_pBuffer == NULL)
+    {
+        TraceBuffer *buffer = new TraceBuffer();
+        buffer->events.reserve(1024);
+
+        std::lock_guard<std::mutex> lock(s_Mutex);
+        buffer->tid = (unsigned int)s_Buffers.size() + 1;
+        s_Buffers.push_back(buffer);
+        t_pBuffer = buffer;
+    }
+    return t_pBuffer;
+}
+
+void enableTrace()
+{
+    s_dEpoch = nowSeconds();
+    s_bEnabled = true;
+}
+
+bool traceEnabled()
+{
+    return s_bEnabled;
+}
+
+void traceComplete(const char *category, const std::string& name, double start, double end)
+{
+    TraceEvent event;
+    event.category = category;
+    event.name = name;
+    event.phase = 'X';
+    event.ts = (start - s_dEpoch) * 1e6;
+    event.dur = (end - start) * 1e6;
+    event.argName = NULL;
+    event.argValue = 0;
+    threadBuffer()->events.push_back(event);
+}
+
+void traceInstant(const char *category, const std::string& name, const char *argName, double argValue)
+{
+    TraceEvent event;
+    event.category = category;
+    event.name = name;
+    event.phase = 'i';
+    event.ts = (nowSeconds() - s_dEpoch) * 1e6;
+    event.dur = 0;
+    event.argName = argName;
+    event.argValue = argValue;
+    threadBuffer()->events.push_back(event);
+}
+
+static void writeString(std::ostream& out, const std::string& s)
+{
+    out << '"';
+    for (std::string::const_iterator it = s.begin(); it != s.end(); it++)
+    {
+        if (*it == '"' || *it == '\\')
+            out << '\\' << *it;
+        else if ((unsigned char)*it < 0x20)
+            out << ' ';
+        else
+            out << *it;
+    }
+    out << '"';
+}
+
+/* Call once all recording threads are done */
+bool writeTrace(const std::string& path)
+{
+    std::ofstream out(path.c_str());
+    if (!out)
+        return false;
+
+    std::lock_guard<std::mutex> lock(s_Mutex);
+    out.setf(ios::fixed);
+    out.precision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+    for (std::vector<TraceBuffer*>::const_iterator b = s_Buffers.begin(); b != s_Buffers.end(); b++)
+    {
+        const std::vector<TraceEvent>& events = (*b)->events;
+        for (std::vector<TraceEvent>::const_iterator e = events.begin(); e != events.end(); e++)
+        {
+            out << (first ? "\n" : ",\n") << "{\"name\":";
+            writeString(out, e->name);
+            out << ",\"cat\":\"" << e->category << "\",\"ph\":\"" << e->phase << "\""
+                << ",\"ts\":" << e->ts << ",\"pid\":1,\"tid\":" << (*b)->tid;
+            if (e->phase == 'X')
+                out << ",\"dur\":" << e->dur;
+            else
+                out << ",\"s\":\"t\"";
+            if (e->argName != NULL)
+                out << ",\"args\":{\"" << e->argName << "\":" << e->argValue << "}";
+            out << "}";
+            first = false;
+        }
+    }
+
+    out << "\n]}\n";
+    return true;
+}
+
+TraceSpan::TraceSpan(const char *category, const std::string& name)
+    : category(category), start(0), active(s_bEnabled)
+{
+    if (active)
+    {
+        this->name = name;
+        start = nowSeconds();
+    }
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (active)
+        traceComplete(category, name, start, nowSeconds());
+}
+
+class TraceJITListener : public llvm::JITEventListener
+{
+public:
+    virtual void NotifyFunctionEmitted(const llvm::Function& F, void *Code, size_t Size,
+                                       const EmittedFunctionDetails& Details)
+    {
+        if (s_bEnabled)
+            traceInstant("jit", F.getName(), "size", (double)Size);
+    }
+};
+
+llvm::JITEventListener* traceJITListener()
+{
+    static TraceJITListener listener;
+    return &listener;
+}
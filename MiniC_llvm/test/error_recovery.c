@@ -0,0 +1,9 @@
+int a = ;
+int b = 2;
+int f(int x)
+{
+    int y = );
+    return x;
+}
+int c = 3 3;
+int d = @4;
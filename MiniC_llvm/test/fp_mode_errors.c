@@ -0,0 +1,4 @@
+double g(double a) fpmode(quick)
+{
+    return a;
+}
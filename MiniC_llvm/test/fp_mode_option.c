@@ -0,0 +1,11 @@
+double fused(double a, double b, double c)
+{
+    return a * b + c;
+}
+
+double exact(double a, double b, double c) fpmode(strict)
+{
+    return a * b + c;
+}
+
+double r = fused(1.0, 2.0, 3.0) + exact(1.0, 2.0, 3.0);
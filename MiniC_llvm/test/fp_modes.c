@@ -0,0 +1,16 @@
+double strict_sum(double a, double b, double c)
+{
+    return a * b + c;
+}
+
+double fast_sum(double a, double b, double c) fpmode(fast)
+{
+    return a * b + c;
+}
+
+double contract_sum(double a, double b, double c) fpmode(contract)
+{
+    return a * b + c;
+}
+
+double r = strict_sum(1.0, 2.0, 3.0) + fast_sum(1.0, 2.0, 3.0) + contract_sum(1.0, 2.0, 3.0);
@@ -0,0 +1,12 @@
+int limit = 10;
+double scale = 2.5;
+int counter = 0;
+
+int bump(int by)
+{
+    counter = counter + by;
+    return counter;
+}
+
+int first = bump(limit);
+double scaled = scale * 2.0;
@@ -0,0 +1,11 @@
+int f()
+{
+    return;
+}
+
+void g()
+{
+    return 1;
+}
+
+return 3;
@@ -0,0 +1,20 @@
+int pick(int x)
+{
+    if (x)
+    {
+        return 1;
+    }
+    return 2;
+}
+
+double half(int x)
+{
+    return x / 2;
+}
+
+void nothing()
+{
+    return;
+}
+
+int p = pick(0);
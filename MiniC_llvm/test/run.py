@@ -0,0 +1,93 @@
+"""Regression tests of the MiniC driver.
+
+Usage: python run.py <MiniC_llvm executable> [test name]...
+
+Every <name>.c next to this script that has a <name>.expect is compiled
+and run by the driver from this directory, so diagnostics name the file
+as <name>.c. The .expect file lists, one per line:
+
+    args: <options>     passed to the driver before the file
+    not: <text>         must not be printed before the next expected text
+    <text>              must be printed, after the text of the line before
+
+Blank lines and lines starting with # are skipped. The exit code is the
+number of failed tests.
+"""
+
+import os
+import subprocess
+import sys
+
+TEST_DIR = os.path.dirname(os.path.abspath(__file__))
+
+
+def readExpect(path):
+    args, checks = [], []
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip('\r\n')
+            if not line.strip() or line.startswith('#'):
+                continue
+            if line.startswith('args:'):
+                args += line[5:].split()
+            elif line.startswith('not:'):
+                checks.append((False, line[4:].strip()))
+            else:
+                checks.append((True, line))
+    return args, checks
+
+
+def check(output, checks):
+    """Returns the first check that fails, or None"""
+    position = 0
+    forbidden = []
+    for wanted, text in checks:
+        if not wanted:
+            forbidden.append(text)
+            continue
+        found = output.find(text, position)
+        if found < 0:
+            return 'missing: ' + text
+        for text in forbidden:
+            if output.find(text, position, found) >= 0:
+                return 'unexpected: ' + text
+        forbidden = []
+        position = found + len(text)
+    for text in forbidden:
+        if output.find(text, position) >= 0:
+            return 'unexpected: ' + text
+    return None
+
+
+def run(driver, name):
+    args, checks = readExpect(os.path.join(TEST_DIR, name + '.expect'))
+    process = subprocess.Popen([driver] + args + [name + '.c'], cwd=TEST_DIR,
+                               stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    output = process.communicate()[0].decode('utf-8', 'replace')
+    return check(output, checks)
+
+
+def main(argv):
+    if len(argv) < 2:
+        print(__doc__)
+        return -1
+
+    driver = os.path.abspath(argv[1])
+    names = argv[2:]
+    if not names:
+        names = sorted(f[:-7] for f in os.listdir(TEST_DIR) if f.endswith('.expect'))
+
+    failed = 0
+    for name in names:
+        failure = run(driver, name)
+        if failure is None:
+            print('PASS ' + name)
+        else:
+            print('FAIL ' + name + ': ' + failure)
+            failed += 1
+    print('%d of %d tests failed' % (failed, len(names)))
+    return failed
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
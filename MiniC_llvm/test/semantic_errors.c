@@ -0,0 +1,12 @@
+int f(int a)
+{
+    return b;
+}
+
+int g()
+{
+    return h(1);
+}
+
+x = 3;
+double d = 1.0;
@@ -0,0 +1,6 @@
+vec4d a = vec4d(1.0, 2.0, 3.0, 4.0);
+vec8i b = vec8i(1);
+vec8i c = a;
+vec4d d = a + b;
+vec4d e = vec4d(1.0, 2.0);
+double x = lane(a, 4);
@@ -0,0 +1,9 @@
+vec4d scale(vec4d v, double k)
+{
+    return v * k;
+}
+
+vec4d a = vec4d(1.0, 2.0, 3.0, 4.0);
+vec8i b = vec8i(1);
+double s = hsum(scale(a, 2.0));
+int n = hmax(b + 3);
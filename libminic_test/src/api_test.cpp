@@ -0,0 +1,132 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "minic.h"
+
+using namespace std;
+
+/* Checks of the embedding API; the exit code is the number that failed */
+static unsigned int s_Failures = 0;
+
+static void expect(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        cout << "FAIL " << what << endl;
+        s_Failures++;
+    }
+}
+
+static void testFunctions(Compiler& compiler)
+{
+    Diagnostics diagnostics;
+    CompiledModule *module = compiler.compileString(
+        "int add(int a, int b)\n"
+        "{\n"
+        "    return a + b;\n"
+        "}\n"
+        "double scale(double x)\n"
+        "{\n"
+        "    return x * 2.5;\n"
+        "}\n", CompileOptions(), diagnostics);
+    expect(module != NULL && !diagnostics.hasErrors(), "functions compile");
+    if (module == NULL)
+        return;
+
+    int (*add)(int, int) = (int (*)(int, int))module->lookup("add");
+    double (*scale)(double) = (double (*)(double))module->lookup("scale");
+    expect(add != NULL && add(2, 3) == 5, "add(2, 3) is 5");
+    expect(scale != NULL && scale(2.0) == 5.0, "scale(2.0) is 5.0");
+    expect(module->lookup("missing") == NULL, "lookup of an undefined function is NULL");
+    delete module;
+}
+
+static void testGlobals(Compiler& compiler)
+{
+    Diagnostics diagnostics;
+    CompiledModule *module = compiler.compileString(
+        "int twice(int a)\n"
+        "{\n"
+        "    return a + a;\n"
+        "}\n"
+        "int base = 21;\n"
+        "int total = twice(base);\n"
+        "double ratio = 0.5;\n", CompileOptions(), diagnostics);
+    expect(module != NULL, "globals compile");
+    if (module == NULL)
+        return;
+
+    int *base = (int *)module->global("base");
+    int *total = (int *)module->global("total");
+    double *ratio = (double *)module->global("ratio");
+    expect(base != NULL && *base == 21, "constant initializers are in place before run()");
+    expect(ratio != NULL && *ratio == 0.5, "double globals are readable");
+    module->run();
+    expect(total != NULL && *total == 42, "run() computes the other initializers");
+    expect(module->global("missing") == NULL, "global of an undefined variable is NULL");
+    delete module;
+}
+
+static void testErrors(Compiler& compiler)
+{
+    Diagnostics syntax;
+    CompiledModule *module = compiler.compileString("int x = ;\nint y = 1;\n", CompileOptions(), syntax);
+    expect(module == NULL, "a syntax error rejects the source");
+    expect(syntax.str("f.mc").find("f.mc(1,9): error:") != string::npos, "syntax errors are located");
+
+    Diagnostics semantic;
+    module = compiler.compileString("int f()\n{\n    return y;\n}\n", CompileOptions(), semantic);
+    expect(module == NULL, "an undeclared variable rejects the source");
+    expect(semantic.str("f.mc").find("f.mc(3,12): error: undeclared variable y") != string::npos, "semantic errors are located");
+
+    /* errors never end the process, the compiler stays usable */
+    Diagnostics diagnostics;
+    module = compiler.compileString("int one()\n{\n    return 1;\n}\n", CompileOptions(), diagnostics);
+    expect(module != NULL, "a compiler that rejected a source compiles the next one");
+    delete module;
+}
+
+/* Every module has its own names, a function may be defined in several */
+static void testModules(Compiler& compiler)
+{
+    Diagnostics diagnostics;
+    CompiledModule *first = compiler.compileString("int value()\n{\n    return 1;\n}\n", CompileOptions(), diagnostics);
+    CompiledModule *second = compiler.compileString("int value()\n{\n    return 2;\n}\n", CompileOptions(), diagnostics);
+    expect(first != NULL && second != NULL, "modules with the same function compile");
+    if (first != NULL && second != NULL)
+    {
+        int (*value1)() = (int (*)())first->lookup("value");
+        int (*value2)() = (int (*)())second->lookup("value");
+        expect(value1 != NULL && value1() == 1 && value2 != NULL && value2() == 2, "each module calls its own function");
+    }
+    delete first;
+    delete second;
+}
+
+/* The buffer is parsed where it lies and needs two zero bytes after the text */
+static void testBuffer(Compiler& compiler)
+{
+    char text[] = "int three()\n{\n    return 3;\n}\n\0";
+    Diagnostics diagnostics;
+    CompiledModule *module = compiler.compileBuffer(text, strlen(text), CompileOptions(), diagnostics);
+    expect(module != NULL, "a buffer compiles");
+    if (module == NULL)
+        return;
+    int (*three)() = (int (*)())module->lookup("three");
+    expect(three != NULL && three() == 3, "three() is 3");
+    delete module;
+}
+
+int main(int argc, char **argv)
+{
+    Compiler compiler;
+    testFunctions(compiler);
+    testGlobals(compiler);
+    testErrors(compiler);
+    testModules(compiler);
+    testBuffer(compiler);
+
+    cout << s_Failures << " failures" << endl;
+    return (int)s_Failures;
+}